@@ -37,23 +37,60 @@ extern "C"
     using ahar_hand = void(*)(std::uint64_t cid, std::uint64_t mid, const atype::astr& name, const atype::abuf& mb);
 }
 
+// ahar_send在多个监听者间的均衡方式（按消息设置，见ahar_setbalance）
+enum BalanceMode
+{
+    BALANCE_ROUND_ROBIN = 0,    // 轮询（默认）
+    BALANCE_LEAST_PENDING,      // 投给排队作业最少的线程
+    BALANCE_STICKY              // 按key一致性哈希，相同key总到同一线程（ahar_sendby；无key时退化为轮询）
+};
+
+// 取得消息缓冲引用的处理函数：所有接收者共享同一份消息体，复制mb只增加引用，可在处理结束后继续持有或转发
+using ahar_hand_buf = void(*)(std::uint64_t cid, std::uint64_t mid, const atype::astr& name, const athd::abuf& mb);
+
+// call应答状态
+enum RpcStatus
+{
+    RPC_OK = 0,
+    RPC_TIMEOUT,        // 超时未应答
+    RPC_NOROUTE         // 没有处理者（或rid不在任何线程），未发出
+};
+
+// call应答函数：在发起调用的线程中执行，每个调用恰好一次；status非RPC_OK时mb为空
+using ahar_resp = void(*)(std::uint64_t cid, int status, const athd::abuf& mb, void* data);
+
 AA_API std::uint64_t ahar_regmsg(atype::astr name, int type);
 AA_API void ahar_listen(atype::astr name, ahar_hand handler, void* data = nullptr, athd::thread* t = nullptr);
+AA_API void ahar_listenbuf(atype::astr name, ahar_hand_buf handler, void* data = nullptr, athd::thread* t = nullptr);
 
 AA_API void ahar_enterct(std::uint64_t oid, ref_lobj lo);
 AA_API void ahar_leavect(std::uint64_t oid);
 
+// 设置消息的均衡方式（见BalanceMode），未注册的消息先注册
+AA_API void ahar_setbalance(atype::astr name, int mode);
+// 投给监听该消息的一个处理者，按消息的均衡方式选择
 AA_API void ahar_send(std::uint64_t mid, const atype::abuf& mb);
+// 同ahar_send，BALANCE_STICKY时按key选择
+AA_API void ahar_sendby(std::uint64_t key, std::uint64_t mid, const atype::abuf& mb);
 AA_API void ahar_send_cross(std::uint64_t mid, const atype::abuf& mb);
 AA_API void ahar_sendto(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb);
+// 发送已有的消息缓冲（如收到后转发），不复制消息体
+AA_API void ahar_sendtobuf(std::uint64_t rid, std::uint64_t mid, const athd::abuf& mb);
 AA_API void ahar_sendto_cross(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb);
 
-AA_API void ahar_call(std::uint64_t mid, const atype::abuf& mb);
-AA_API void ahar_call_cross(std::uint64_t mid, const atype::abuf& mb);
-AA_API void ahar_callto(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb);
-AA_API void ahar_callto_cross(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb);
+// 请求/应答：须在athd线程中调用，返回关联ID（0：参数错误，不会回调），处理函数的cid参数即此ID，
+//    处理线程用ahar_reply(cid, ...)应答，应答回到发起线程执行cb；timeout_ms为0时用默认30秒
+//    call按ahar_setbalance的方式选一个处理者，callto投给rid所在线程
+AA_API std::uint64_t ahar_call(std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data = nullptr, std::uint32_t timeout_ms = 0);
+AA_API std::uint64_t ahar_callto(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data = nullptr, std::uint32_t timeout_ms = 0);
+// 跨进程版本：传输尚未实现，请求不会发出，cb总是异步收到RPC_NOROUTE
+AA_API std::uint64_t ahar_call_cross(std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data = nullptr, std::uint32_t timeout_ms = 0);
+AA_API std::uint64_t ahar_callto_cross(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data = nullptr, std::uint32_t timeout_ms = 0);
+// 应答call请求，须在收到请求的线程中调用（可在处理函数返回后），每个cid只能应答一次，返回是否送出
+AA_API bool ahar_reply(std::uint64_t cid, const atype::abuf& mb);
 
 AA_API void ahar_svcbc(std::uint64_t mid, const atype::abuf& mb);
+AA_API void ahar_svcbcbuf(std::uint64_t mid, const athd::abuf& mb);
 AA_API void ahar_svcbc_cross(std::uint64_t mid, const atype::abuf& mb);
 AA_API void ahar_gatebc(std::uint64_t mid, const atype::abuf& mb);
 
@@ -74,6 +111,11 @@ namespace ahar
         ahar_listen(name, handler, data, t);
     }
 
+    inline void listen(atype::astr name, ahar_hand_buf handler, void* data = nullptr, athd::thread* t = nullptr)
+    {
+        ahar_listenbuf(name, handler, data, t);
+    }
+
     inline void enterct(std::uint64_t oid, ref_lobj lo)
     {
         ahar_enterct(oid, lo);
@@ -84,11 +126,26 @@ namespace ahar
         ahar_leavect(oid);
     }
 
+    inline void setbalance(atype::astr name, BalanceMode mode)
+    {
+        ahar_setbalance(name, mode);
+    }
+
     inline void send(std::uint64_t mid, const atype::abuf& mb)
     {
         ahar_send(mid, mb);
     }
 
+    inline void sendby(std::uint64_t key, std::uint64_t mid, const atype::abuf& mb)
+    {
+        ahar_sendby(key, mid, mb);
+    }
+
+    inline void sendby(std::uint64_t key, const std::string_view& mname, const atype::abuf& mb)
+    {
+        ahar_sendby(key, aid::crc32(mname), mb);
+    }
+
     inline void send_cross(std::uint64_t mid, const atype::abuf& mb)
     {
         ahar_send_cross(mid, mb);
@@ -109,6 +166,11 @@ namespace ahar
         ahar_sendto(rid, mid, mb);
     }
 
+    inline void sendto(std::uint64_t rid, std::uint64_t mid, const athd::abuf& mb)
+    {
+        ahar_sendtobuf(rid, mid, mb);
+    }
+
     inline void sendto_cross(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb)
     {
         ahar_sendto_cross(rid, mid, mb);
@@ -124,11 +186,41 @@ namespace ahar
         ahar_sendto_cross(rid, aid::crc32(mname), mb);
     }
 
+    inline std::uint64_t call(std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data = nullptr, std::uint32_t timeout_ms = 0)
+    {
+        return ahar_call(mid, mb, cb, data, timeout_ms);
+    }
+
+    inline std::uint64_t call(const std::string_view& mname, const atype::abuf& mb, ahar_resp cb, void* data = nullptr, std::uint32_t timeout_ms = 0)
+    {
+        return ahar_call(aid::crc32(mname), mb, cb, data, timeout_ms);
+    }
+
+    inline std::uint64_t callto(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data = nullptr, std::uint32_t timeout_ms = 0)
+    {
+        return ahar_callto(rid, mid, mb, cb, data, timeout_ms);
+    }
+
+    inline std::uint64_t callto(std::uint64_t rid, const std::string_view& mname, const atype::abuf& mb, ahar_resp cb, void* data = nullptr, std::uint32_t timeout_ms = 0)
+    {
+        return ahar_callto(rid, aid::crc32(mname), mb, cb, data, timeout_ms);
+    }
+
+    inline bool reply(std::uint64_t cid, const atype::abuf& mb)
+    {
+        return ahar_reply(cid, mb);
+    }
+
     inline void svcbc(std::uint64_t mid, const atype::abuf& mb)
     {
         ahar_svcbc(mid, mb);
     }
 
+    inline void svcbc(std::uint64_t mid, const athd::abuf& mb)
+    {
+        ahar_svcbcbuf(mid, mb);
+    }
+
     inline void svcbc_cross(std::uint64_t mid, const atype::abuf& mb)
     {
         ahar_svcbc_cross(mid, mb);
@@ -13,13 +13,33 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <format>
 #include <utility>
+#include <algorithm>
+#include <charconv>
+#include <system_error>
+#include <type_traits>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 
 #include "aos.h"
 
+namespace alog
+{
+    // 日志队列统计（alog_getqueue）
+    struct queue_stats
+    {
+        std::uint64_t count_ = 0;           // 排队中的日志条数
+        std::uint64_t bytes_ = 0;           // 排队中的日志字节数
+        std::uint64_t budget_ = 0;          // 字节预算，0不限
+        std::uint64_t drop_info_ = 0;       // 超预算丢弃的INFO条数（累计）
+        std::uint64_t drop_debug_ = 0;      // 超预算丢弃的DEBUG条数（累计）
+        std::uint64_t drop_warning_ = 0;    // 超预算丢弃的WARNING条数（累计）
+    };
+}
+
 AA_API void* alog_addfile(const char* file_name);
 AA_API void alog_print(void* file, int level, const char* txt_addr, std::size_t txt_size);
 AA_API std::size_t alog_stack_trace_to_buf(char* buf, std::size_t buf_size, int start = 0);
@@ -32,6 +52,51 @@ AA_API bool alog_is_print_debug();
 AA_API bool alog_is_print_stack_on_error();
 AA_API int alog_get_error_count();
 AA_API void alog_get_buf(char** pbuf, std::size_t* psize);
+// 落盘策略：mode见alog::SyncMode，ms/bytes为SYNC_INTERVAL的时间/字节阈值
+AA_API void alog_setsync(int mode, std::uint64_t ms, std::uint64_t bytes);
+// 各等级分文件（默认true：*_info.log/*_error.log...），false：所有等级写入同一个*_all.log
+AA_API void alog_setsplitlevel(bool v);
+// 线程日志环：bytes为新建环的容量（2的幂，默认256KB），policy见alog::RingPolicy
+AA_API void alog_setring(std::uint64_t bytes, int policy);
+// 二进制模式：INFO/WARNING日志在调用线程只记录格式串地址与原始参数，由日志线程格式化
+AA_API void alog_setbinary(bool v);
+AA_API bool alog_is_binary();
+// 调用点限流：每个调用点（key）每秒per_sec条、突发burst条，超出的日志丢弃并定期输出“(repeated N times)”汇总行；
+//    ERROR同一调用点trace_ms毫秒内只取一次调用栈；per_sec为0关闭限流，trace_ms为0每次都取
+//    默认：不限流（per_sec为0），ERROR调用栈1秒内同一调用点只取一次（不丢日志）
+AA_API void alog_setratelimit(double per_sec, std::uint32_t burst, std::uint64_t trace_ms);
+// 调用点准入，返回alog::AdmitFlag组合；key为0不限流
+AA_API int alog_admit(void* file, int level, std::uint64_t key, const char* desc, std::size_t desc_size);
+// 日志队列字节预算：排队字节超过预算的3/4丢弃DEBUG/INFO，超过预算时WARNING按policy（alog::OverloadPolicy）等待或丢弃，
+//    ERROR始终保留；bytes为0不限
+AA_API void alog_setbudget(std::uint64_t bytes, int policy);
+AA_API void alog_getqueue(alog::queue_stats* out);
+// 按大小切分：单个日志文件达到max_bytes后切到同一小时的下一个分片（..._info.1.log、..._info.2.log…），0只按整点切分
+AA_API void alog_setrotate(std::uint64_t max_bytes);
+// 保留策略：后台低优先级线程按文件数、总字节数、存在时长清理本服务日志目录下的旧文件（先删最旧），
+//    正在写的文件不删；各项为0表示不限，全为0不清理；日志线程不做删除
+AA_API void alog_setretention(std::uint32_t max_files, std::uint64_t max_bytes, std::uint64_t max_age_sec);
+// 换出文件压缩：整点/按大小换出的文件由后台低优先级线程压缩为..._info.log.gz（多成员gzip，zcat可读）并生成.idx索引，
+//    成功后删除原文件；level为gzip级别1~9，0不压缩；cpu_percent为压缩线程占用单核的上限（1~100）
+AA_API void alog_setcompress(int level, std::uint32_t cpu_percent);
+// 内存映射写（Linux）：之后打开的日志文件按chunk_bytes预分配（fallocate）并映射，记录直接拷贝进映射区，
+//    由内核页回写落盘，进程崩溃时已写入的记录不丢；关闭文件时截掉未用部分；0恢复stdio写
+AA_API void alog_setmmap(std::uint64_t chunk_bytes);
+// 共享内存实时日志环（Linux，默认4MB）：日志线程把最近的日志拷贝到共享内存"/aalog.服务标志"，
+//    用aalog-tail工具按等级/线程/日志文件过滤跟踪，不经屏幕输出、不影响进程和磁盘；setroot前设置，0不开启
+AA_API void alog_setlive(std::uint64_t bytes);
+// 崩溃转储（Linux，默认开启，setroot时安装致命信号处理）：进程因SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT结束前，
+//    把崩溃线程的原始调用栈、各athd线程当前作业、未写出的日志和/proc/self/maps写入日志目录下的crash_*.log
+AA_API void alog_setcrashdump(bool v);
+// 结构化日志（alog::kv）的编码格式，见alog::KvFormat
+AA_API void alog_setkvformat(int format);
+AA_API int alog_get_kvformat();
+// 提交文本并附带调用栈：调用线程只取原始帧地址，由日志线程解析并按调用栈去重（start为额外跳过的帧数）
+AA_API void alog_print_traced(void* file, int level, const char* txt_addr, std::size_t txt_size, int start);
+// 提交二进制记录（见alog::pvt::bin_head）
+AA_API void alog_print_binary(void* file, int level, const char* rec_addr, std::size_t rec_size);
+// 遍历各线程因环满丢弃的日志数，tid为0表示已退出线程的合计
+AA_API void alog_getdrops(void (*fn)(void* ud, std::uint64_t tid, std::uint64_t count), void* ud);
 
 namespace alog
 {
@@ -44,87 +109,694 @@ namespace alog
         LEVEL_ERROR
     };
 
+    // 落盘策略：日志线程每批日志每个文件只写一次，再按策略fsync
+    enum SyncMode
+    {
+        SYNC_NONE = 0,      // 不主动fsync，由操作系统页缓存回写
+        SYNC_INTERVAL,      // 每隔ms毫秒或累计bytes字节fsync一次（默认1000ms/1MB）
+        SYNC_ERROR          // 仅含ERROR日志的批次fsync
+    };
+
+    // 线程日志环写满时的策略
+    enum RingPolicy
+    {
+        RING_BLOCK = 0,     // 等待日志线程腾出空间（setroot之前退化为RING_SPILL）
+        RING_DROP,          // 丢弃并计数（见alog_getdrops）
+        RING_SPILL          // 转入加锁的溢出链表（默认）
+    };
+
+    // 格式串：编译期解析{}占位符位置，占位符个数与参数个数不符时编译失败
+    //    运行期格式串用alog::runtime()包装，多余占位符原样输出、多余参数忽略
+    struct runtime_fmt
+    {
+        const char* str_;
+    };
+
+    inline runtime_fmt runtime(const char* fmt)
+    {
+        return runtime_fmt{fmt ? fmt : ""};
+    }
+
+    // 超出队列预算时WARNING的处理
+    enum OverloadPolicy
+    {
+        OVERLOAD_DROP = 0,  // 丢弃并计数（默认）
+        OVERLOAD_BLOCK      // 等待日志线程消化到预算以内（setroot之前退化为丢弃）
+    };
+
+    // 结构化日志编码格式
+    enum KvFormat
+    {
+        KV_JSON = 0,        // {"event":"login","uid":1001,"ms":3.5}（默认）
+        KV_LOGFMT           // event=login uid=1001 ms=3.5
+    };
+
+    // 结构化日志字段：值按类型保存，字符串只保存视图（编码在调用内完成，不拷贝、不分配）
+    class field
+    {
+    public:
+        enum Type : unsigned char
+        {
+            T_NONE = 0,
+            T_INT,
+            T_UINT,
+            T_FLOAT,
+            T_BOOL,
+            T_STR
+        };
+
+        constexpr field() = default;
+
+        template<typename T>
+        field(std::string_view key, const T& v)
+            : key_(key)
+        {
+            using D = std::decay_t<T>;
+            if constexpr (std::is_same_v<D, bool>)
+            {
+                type_ = T_BOOL;
+                b_ = v;
+            }
+            else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>)
+            {
+                type_ = T_INT;
+                i_ = v;
+            }
+            else if constexpr (std::is_integral_v<D>)
+            {
+                type_ = T_UINT;
+                u_ = v;
+            }
+            else if constexpr (std::is_enum_v<D>)
+            {
+                type_ = std::is_signed_v<std::underlying_type_t<D>> ? T_INT : T_UINT;
+                i_ = static_cast<std::int64_t>(v);
+            }
+            else if constexpr (std::is_floating_point_v<D>)
+            {
+                type_ = T_FLOAT;
+                f_ = v;
+            }
+            else if constexpr (std::is_same_v<D, const char*> || std::is_same_v<D, char*>)
+            {
+                type_ = T_STR;
+                s_ = v ? v : "(null)";
+            }
+            else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+            {
+                type_ = T_STR;
+                s_ = v;
+            }
+            else
+            {
+                static_assert(std::is_same_v<D, void>, "alog::field: 不支持的值类型");
+            }
+        }
+
+    public:
+        std::string_view key_;
+        Type type_ = T_NONE;
+        union
+        {
+            std::int64_t i_ = 0;
+            std::uint64_t u_;
+            double f_;
+            bool b_;
+        };
+        std::string_view s_;
+    };
+
+    // alog_admit的返回值
+    enum AdmitFlag
+    {
+        ADMIT_PASS = 1,     // 输出本条日志
+        ADMIT_TRACE = 2     // 附加调用栈（ERROR）
+    };
+
     namespace pvt
     {
-        /* ---------- 1. 把单个参数转成字符串（栈缓存） ---------- */
-        inline void to_str(char* buf, std::size_t n, const std::string_view& v)           { std::snprintf(buf, n, "%s", v.data()); }
-        inline void to_str(char* buf, std::size_t n, int v)           { std::snprintf(buf, n, "%d", v); }
-        inline void to_str(char* buf, std::size_t n, unsigned int v) { std::snprintf(buf, n, "%u", v); }
-        inline void to_str(char* buf, std::size_t n, long v)         { std::snprintf(buf, n, "%ld", v); }
-        inline void to_str(char* buf, std::size_t n, unsigned long v){ std::snprintf(buf, n, "%lu", v); }
-        inline void to_str(char* buf, std::size_t n, double v)       { std::snprintf(buf, n, "%.6f", v); }
-        inline void to_str(char* buf, std::size_t n, const char* s)  { std::strncpy(buf, s, n - 1); buf[n - 1] = '\0'; }
-        inline void to_str(char* buf, std::size_t n, const std::string& s) { to_str(buf, n, s.c_str()); }
-
-        /* ---------- 2. 运行时解析 {} 并渲染 ---------- */
-        template <typename... Args>
-        std::size_t format_runtime(char* out, std::size_t outSize,
-                                const char* fmt, Args&&... args)
-        {
-            /* 1. 默认构造数组（C++11 合法） */
-            std::string pieces[sizeof...(Args)] = {};
-
-            /* 2. 逐个转成字符串 */
-            std::size_t idx = 0;
-            auto fill = [&](auto&& v) {
-                char tmp[256];
-                to_str(tmp, sizeof(tmp), v);
-                pieces[idx++] = tmp;
-            };
-            /* 用逗号表达式展开即可，C++11 可用 */
-            using expander = int[];
-            (void)expander{0, (fill(std::forward<Args>(args)), 0)...};
-
-            /* 3. 按 fmt 拼结果 */
-            std::string result;
-            result.reserve(std::strlen(fmt) + sizeof...(Args) * 32);
-            idx = 0;
-            for (const char* p = fmt; *p; ++p) {
-                if (*p == '{' && *(p + 1) == '}') {
-                    if (idx < sizeof...(Args)) result += pieces[idx++];
-                    ++p;                 // 跳过 '}'
-                } else {
-                    result += *p;
+        // 非constexpr函数，编译期调用即报错，报错信息带出函数名
+        inline void format_placeholder_count_mismatch() {}
+
+        template<typename... Args>
+        class basic_fmt_string
+        {
+        public:
+            template<typename T>
+                requires std::is_convertible_v<const T&, std::string_view>
+            consteval basic_fmt_string(const T& fmt)
+                : str_(fmt), is_static_(true)
+            {
+                if (parse() != sizeof...(Args))
+                {
+                    format_placeholder_count_mismatch();
+                }
+            }
+
+            basic_fmt_string(runtime_fmt fmt)
+                : str_(fmt.str_)
+            {
+                parse();
+            }
+
+            std::string_view get() const
+            {
+                return str_;
+            }
+
+            // 编译期格式串（字面量，地址在进程内长期有效）
+            bool is_static() const
+            {
+                return is_static_;
+            }
+
+            // 第i个占位符在格式串中的偏移，末项为格式串长度
+            std::size_t pos(std::size_t i) const
+            {
+                return pos_[i];
+            }
+
+        private:
+            constexpr std::size_t parse()
+            {
+                std::size_t count = 0;
+                for (std::size_t i = 0; i + 1 < str_.size(); ++i)
+                {
+                    if (str_[i] == '{' && str_[i + 1] == '}')
+                    {
+                        if (count < sizeof...(Args))
+                        {
+                            pos_[count] = i;
+                        }
+                        ++count;
+                        ++i;
+                    }
                 }
+                for (auto i = std::min(count, sizeof...(Args)); i < sizeof...(Args); ++i)
+                {
+                    pos_[i] = str_.size();
+                }
+                pos_[sizeof...(Args)] = str_.size();
+                return count;
+            }
+
+            std::string_view str_;
+            bool is_static_ = false;
+            std::size_t pos_[sizeof...(Args) + 1] = {};
+        };
+
+        // 定长输出，超出部分截断
+        class writer
+        {
+        public:
+            writer(char* buf, std::size_t size)
+                : p_(buf), end_(buf + size)
+            {
+            }
+
+            void put(const char* s, std::size_t n)
+            {
+                n = std::min(n, static_cast<std::size_t>(end_ - p_));
+                std::memcpy(p_, s, n);
+                p_ += n;
+            }
+
+            template<typename T>
+            void put_chars(T v, int base = 10)
+            {
+                auto r = std::to_chars(p_, end_, v, base);
+                if (r.ec == std::errc())
+                {
+                    p_ = r.ptr;
+                    return;
+                }
+                char tmp[32];
+                r = std::to_chars(tmp, tmp + sizeof(tmp), v, base);
+                put(tmp, r.ptr - tmp);
+            }
+
+            void put_fixed(double v)
+            {
+                // 与原%.6f一致
+                auto r = std::to_chars(p_, end_, v, std::chars_format::fixed, 6);
+                if (r.ec == std::errc())
+                {
+                    p_ = r.ptr;
+                    return;
+                }
+                char tmp[400];
+                r = std::to_chars(tmp, tmp + sizeof(tmp), v, std::chars_format::fixed, 6);
+                put(tmp, r.ec == std::errc() ? r.ptr - tmp : 0);
+            }
+
+            void put_shortest(double v)
+            {
+                auto r = std::to_chars(p_, end_, v);
+                if (r.ec == std::errc())
+                {
+                    p_ = r.ptr;
+                    return;
+                }
+                char tmp[32];
+                r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+                put(tmp, r.ec == std::errc() ? r.ptr - tmp : 0);
+            }
+
+            char* ptr() const
+            {
+                return p_;
             }
 
-            /* 4. 输出到缓冲区 */
-            std::size_t len = result.size();
-            if (len >= outSize) len = outSize - 1;
-            std::memcpy(out, result.data(), len);
-            out[len] = '\0';
+            std::size_t remain() const
+            {
+                return end_ - p_;
+            }
+
+        private:
+            char* p_;
+            char* end_;
+        };
+
+        template<typename T>
+        inline constexpr bool unsupported_arg = false;
+
+        template<typename T>
+        inline void put_arg(writer& w, const T& v)
+        {
+            using D = std::decay_t<T>;
+            if constexpr (std::is_same_v<D, bool>)
+            {
+                w.put_chars(static_cast<int>(v));
+            }
+            else if constexpr (std::is_integral_v<D>)
+            {
+                w.put_chars(v);
+            }
+            else if constexpr (std::is_enum_v<D>)
+            {
+                w.put_chars(static_cast<std::underlying_type_t<D>>(v));
+            }
+            else if constexpr (std::is_floating_point_v<D>)
+            {
+                w.put_fixed(static_cast<double>(v));
+            }
+            else if constexpr (std::is_same_v<D, const char*> || std::is_same_v<D, char*>)
+            {
+                const char* s = v ? v : "(null)";
+                w.put(s, std::strlen(s));
+            }
+            else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+            {
+                std::string_view sv = v;
+                w.put(sv.data(), sv.size());
+            }
+            else if constexpr (std::is_pointer_v<D>)
+            {
+                w.put("0x", 2);
+                w.put_chars(reinterpret_cast<std::uintptr_t>(v), 16);
+            }
+            else
+            {
+                static_assert(unsupported_arg<T>, "alog: 不支持的参数类型");
+            }
+        }
+
+        // 按编译期占位符位置分段写入，返回长度（不含结尾0）
+        template<typename... Args>
+        std::size_t format_to(char* out, std::size_t out_size,
+                              const basic_fmt_string<Args...>& fmt, const Args&... args)
+        {
+            writer w(out, out_size - 1);
+            auto str = fmt.get();
+            std::size_t from = 0;
+            // 无参数时只写格式串，不生成分段写入的lambda（避免未使用告警）
+            if constexpr (sizeof...(Args) > 0)
+            {
+                std::size_t i = 0;
+                auto put_one = [&](const auto& v)
+                {
+                    auto to = fmt.pos(i++);
+                    w.put(str.data() + from, to - from);
+                    if (to < str.size())
+                    {
+                        put_arg(w, v);
+                        from = to + 2;
+                    }
+                    else
+                    {
+                        from = to;
+                    }
+                };
+                (put_one(args), ...);
+            }
+            w.put(str.data() + from, str.size() - from);
+
+            std::size_t len = w.ptr() - out;
+            out[len] = 0;
             return len;
         }
 
+        // 二进制记录：[bin_head][类型标记+参数值]...，由日志线程按格式串还原为文本
+        //    格式串只记地址，须为字面量且所在模块不会被卸载
+        struct bin_head
+        {
+            const char* fmt_;
+            std::uint32_t fmt_size_;
+            std::uint32_t argc_;
+        };
+
+        enum BinTag : char
+        {
+            BIN_INT = 'i',      // std::int64_t
+            BIN_UINT = 'u',     // std::uint64_t
+            BIN_FLOAT = 'f',    // double
+            BIN_STR = 's',      // std::uint32_t长度 + 内容
+            BIN_PTR = 'p'       // std::uint64_t
+        };
+
+        template<typename V>
+        inline bool put_bin(writer& w, BinTag tag, V v)
+        {
+            if (w.remain() < 1 + sizeof(v))
+            {
+                return false;
+            }
+            char t = tag;
+            w.put(&t, 1);
+            w.put(reinterpret_cast<const char*>(&v), sizeof(v));
+            return true;
+        }
+
+        inline bool put_bin_str(writer& w, const char* s, std::size_t n)
+        {
+            if (w.remain() < 1 + sizeof(std::uint32_t))
+            {
+                return false;
+            }
+            n = std::min(n, w.remain() - 1 - sizeof(std::uint32_t));
+            put_bin(w, BIN_STR, static_cast<std::uint32_t>(n));
+            w.put(s, n);
+            return true;
+        }
+
+        template<typename T>
+        inline bool put_bin_arg(writer& w, const T& v)
+        {
+            using D = std::decay_t<T>;
+            if constexpr (std::is_same_v<D, bool>)
+            {
+                return put_bin(w, BIN_INT, static_cast<std::int64_t>(v));
+            }
+            else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>)
+            {
+                return put_bin(w, BIN_INT, static_cast<std::int64_t>(v));
+            }
+            else if constexpr (std::is_integral_v<D>)
+            {
+                return put_bin(w, BIN_UINT, static_cast<std::uint64_t>(v));
+            }
+            else if constexpr (std::is_enum_v<D>)
+            {
+                return put_bin_arg(w, static_cast<std::underlying_type_t<D>>(v));
+            }
+            else if constexpr (std::is_floating_point_v<D>)
+            {
+                return put_bin(w, BIN_FLOAT, static_cast<double>(v));
+            }
+            else if constexpr (std::is_same_v<D, const char*> || std::is_same_v<D, char*>)
+            {
+                const char* s = v ? v : "(null)";
+                return put_bin_str(w, s, std::strlen(s));
+            }
+            else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+            {
+                std::string_view sv = v;
+                return put_bin_str(w, sv.data(), sv.size());
+            }
+            else if constexpr (std::is_pointer_v<D>)
+            {
+                return put_bin(w, BIN_PTR, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(v)));
+            }
+            else
+            {
+                static_assert(unsupported_arg<T>, "alog: 不支持的参数类型");
+                return false;
+            }
+        }
+
+        // 编码失败（缓冲不足）返回0，调用方改走文本格式化
         template<typename... Args>
-        inline void print(void* file, LogLevel level, const char* fmt, Args&&... args)
+        std::size_t encode_to(char* out, std::size_t out_size,
+                              const basic_fmt_string<Args...>& fmt, const Args&... args)
+        {
+            bin_head head{fmt.get().data(), static_cast<std::uint32_t>(fmt.get().size()), sizeof...(Args)};
+            writer w(out, out_size);
+            w.put(reinterpret_cast<const char*>(&head), sizeof(head));
+            if ((put_bin_arg(w, args) && ...))
+            {
+                return w.ptr() - out;
+            }
+            return 0;
+        }
+
+        // 已格式化文本交给日志线程，is_trace附加调用栈
+        inline void submit(void* file, LogLevel level, char* buf_addr, std::size_t txt_size, bool is_trace)
+        {
+            if (is_trace)
+            {
+                alog_print_traced(file, level, buf_addr, txt_size, 1);
+                return;
+            }
+            alog_print(file, level, buf_addr, txt_size);
+        }
+
+        // 结构化日志的调用点键：事件名哈希（C++与Lua一致）
+        inline std::uint64_t kv_key(std::string_view event)
+        {
+            std::uint64_t h = 14695981039346656037ull;
+            for (unsigned char c : event)
+            {
+                h = (h ^ c) * 1099511628211ull;
+            }
+            return h | 1;
+        }
+
+        // JSON字符串转义（不含两侧引号），连续的普通字符整段拷贝
+        inline void put_escaped(writer& w, std::string_view s)
+        {
+            static constexpr char hex[] = "0123456789abcdef";
+            std::size_t from = 0;
+            for (std::size_t i = 0; i < s.size(); ++i)
+            {
+                auto c = static_cast<unsigned char>(s[i]);
+                if (c >= 0x20 && c != '"' && c != '\\')
+                {
+                    continue;
+                }
+                w.put(s.data() + from, i - from);
+                from = i + 1;
+                switch (c)
+                {
+                case '"':
+                    w.put("\\\"", 2);
+                    break;
+                case '\\':
+                    w.put("\\\\", 2);
+                    break;
+                case '\n':
+                    w.put("\\n", 2);
+                    break;
+                case '\r':
+                    w.put("\\r", 2);
+                    break;
+                case '\t':
+                    w.put("\\t", 2);
+                    break;
+                default:
+                {
+                    char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                    w.put(u, 6);
+                    break;
+                }
+                }
+            }
+            w.put(s.data() + from, s.size() - from);
+        }
+
+        inline void put_kv_str(writer& w, int format, std::string_view s)
         {
+            if (format == KV_LOGFMT)
+            {
+                // logfmt：含空白、=、引号或为空时加引号
+                bool is_plain = !s.empty();
+                for (unsigned char c : s)
+                {
+                    if (c <= ' ' || c == '=' || c == '"')
+                    {
+                        is_plain = false;
+                        break;
+                    }
+                }
+                if (is_plain)
+                {
+                    w.put(s.data(), s.size());
+                    return;
+                }
+            }
+            w.put("\"", 1);
+            put_escaped(w, s);
+            w.put("\"", 1);
+        }
+
+        inline void put_kv_value(writer& w, int format, const field& f)
+        {
+            switch (f.type_)
+            {
+            case field::T_INT:
+                w.put_chars(f.i_);
+                break;
+            case field::T_UINT:
+                w.put_chars(f.u_);
+                break;
+            case field::T_FLOAT:
+                if (format == KV_JSON && (f.f_ != f.f_ || f.f_ - f.f_ != 0))
+                {
+                    w.put("null", 4);   // JSON无NaN/Inf
+                }
+                else
+                {
+                    w.put_shortest(f.f_);
+                }
+                break;
+            case field::T_BOOL:
+                f.b_ ? w.put("true", 4) : w.put("false", 5);
+                break;
+            case field::T_STR:
+                put_kv_str(w, format, f.s_);
+                break;
+            default:
+                break;
+            }
+        }
+
+        inline void put_kv_begin(writer& w, int format, std::string_view event)
+        {
+            if (format == KV_LOGFMT)
+            {
+                w.put("event=", 6);
+                put_kv_str(w, format, event);
+                return;
+            }
+            w.put("{\"event\":", 9);
+            put_kv_str(w, format, event);
+        }
+
+        inline void put_kv_field(writer& w, int format, const field& f)
+        {
+            if (format == KV_LOGFMT)
+            {
+                w.put(" ", 1);
+                w.put(f.key_.data(), f.key_.size());
+                w.put("=", 1);
+            }
+            else
+            {
+                w.put(",\"", 2);
+                put_escaped(w, f.key_);
+                w.put("\":", 2);
+            }
+            put_kv_value(w, format, f);
+        }
+
+        inline void put_kv_end(writer& w, int format)
+        {
+            if (format == KV_JSON)
+            {
+                w.put("}", 1);
+            }
+        }
+
+        inline void print_kv(void* file, LogLevel level, std::string_view event, const field* const* fields, std::size_t count)
+        {
+            if (level == LEVEL_DEBUG && !alog_is_print_debug())
+            {
+                return;
+            }
+            int flags = alog_admit(file, level, kv_key(event), event.data(), event.size());
+            if (!(flags & ADMIT_PASS))
+            {
+                return;
+            }
+
             char* buf_addr;
             std::size_t buf_size;
             alog_get_buf(&buf_addr, &buf_size);
 
-            std::size_t txt_size = format_runtime(buf_addr, buf_size, fmt,
-                                                std::forward<Args>(args)...);
-            if (level == LEVEL_ERROR && txt_size + 3 < buf_size && alog_is_print_stack_on_error())
+            int format = alog_get_kvformat();
+            writer w(buf_addr, buf_size - 1);
+            put_kv_begin(w, format, event);
+            for (std::size_t i = 0; i < count; ++i)
             {
-                buf_addr[txt_size++] = '\r';
-                buf_addr[txt_size++] = '\n';
-                std::size_t stack_size = alog_stack_trace_to_buf(buf_addr + txt_size, buf_size - txt_size, 1);
-                txt_size += stack_size;
-                buf_addr[txt_size] = 0;
+                if (fields[i]->type_ != field::T_NONE)
+                {
+                    put_kv_field(w, format, *fields[i]);
+                }
             }
-            alog_print(file, level, buf_addr, txt_size);
+            put_kv_end(w, format);
+            std::size_t txt_size = w.ptr() - buf_addr;
+            buf_addr[txt_size] = 0;
+            submit(file, level, buf_addr, txt_size, flags & ADMIT_TRACE);
+        }
+
+        // 编译期格式串以地址为调用点键
+        template<typename... Args>
+        inline int admit(void* file, LogLevel level, const basic_fmt_string<Args...>& fmt)
+        {
+            auto str = fmt.get();
+            std::uint64_t key = fmt.is_static() ? reinterpret_cast<std::uintptr_t>(str.data()) : 0;
+            return alog_admit(file, level, key, str.data(), str.size());
+        }
+
+        template<typename... Args>
+        inline void print(void* file, LogLevel level, const basic_fmt_string<Args...>& fmt, const Args&... args)
+        {
+            int flags = admit(file, level, fmt);
+            if (!(flags & ADMIT_PASS))
+            {
+                return;
+            }
+
+            char* buf_addr;
+            std::size_t buf_size;
+            alog_get_buf(&buf_addr, &buf_size);
+
+            // ERROR需在调用线程取调用栈，DEBUG不在热路径，均直接格式化
+            if ((level == LEVEL_INFO || level == LEVEL_WARNING) && fmt.is_static() && alog_is_binary())
+            {
+                std::size_t rec_size = encode_to(buf_addr, buf_size, fmt, args...);
+                if (rec_size)
+                {
+                    alog_print_binary(file, level, buf_addr, rec_size);
+                    return;
+                }
+            }
+
+            std::size_t txt_size = format_to(buf_addr, buf_size, fmt, args...);
+            submit(file, level, buf_addr, txt_size, flags & ADMIT_TRACE);
         }
     }    
 
     template<typename... Args>
-    inline void info(const char* fmt, Args... args)
+    using fmt_string = pvt::basic_fmt_string<std::type_identity_t<Args>...>;
+
+    template<typename... Args>
+    inline void info(fmt_string<Args...> fmt, const Args&... args)
     {
         pvt::print(nullptr, LEVEL_INFO, fmt, args...);
     }
 
     template<typename... Args>
-    inline void debug(const char* fmt, Args... args)
+    inline void debug(fmt_string<Args...> fmt, const Args&... args)
     {
         if (!alog_is_print_debug())
         {
@@ -134,28 +806,50 @@ namespace alog
     }
 
     template<typename... Args>
-    inline void warning(const char* fmt, Args... args)
+    inline void warning(fmt_string<Args...> fmt, const Args&... args)
     {
         pvt::print(nullptr, LEVEL_WARNING, fmt, args...);
     }
 
     template<typename... Args>
-    inline void error(const char* fmt, Args... args)
+    inline void error(fmt_string<Args...> fmt, const Args&... args)
     {
         pvt::print(nullptr, LEVEL_ERROR, fmt, args...);
     }
 
+    // 结构化日志：alog::kv(LEVEL_INFO, "login", {"uid", uid}, {"ms", ms})，最多16个字段
+    //    按alog_setkvformat编码为一行JSON或logfmt，与文本日志同文件、同队列
+    inline void kv(LogLevel level, std::string_view event,
+        const field& f1 = {}, const field& f2 = {}, const field& f3 = {}, const field& f4 = {},
+        const field& f5 = {}, const field& f6 = {}, const field& f7 = {}, const field& f8 = {},
+        const field& f9 = {}, const field& f10 = {}, const field& f11 = {}, const field& f12 = {},
+        const field& f13 = {}, const field& f14 = {}, const field& f15 = {}, const field& f16 = {})
+    {
+        const field* fields[] = {&f1, &f2, &f3, &f4, &f5, &f6, &f7, &f8, &f9, &f10, &f11, &f12, &f13, &f14, &f15, &f16};
+        pvt::print_kv(nullptr, level, event, fields, 16);
+    }
+
     class file final
     {
     public:
+        inline void kv(LogLevel level, std::string_view event,
+            const field& f1 = {}, const field& f2 = {}, const field& f3 = {}, const field& f4 = {},
+            const field& f5 = {}, const field& f6 = {}, const field& f7 = {}, const field& f8 = {},
+            const field& f9 = {}, const field& f10 = {}, const field& f11 = {}, const field& f12 = {},
+            const field& f13 = {}, const field& f14 = {}, const field& f15 = {}, const field& f16 = {})
+        {
+            const field* fields[] = {&f1, &f2, &f3, &f4, &f5, &f6, &f7, &f8, &f9, &f10, &f11, &f12, &f13, &f14, &f15, &f16};
+            pvt::print_kv(this, level, event, fields, 16);
+        }
+
         template<typename... Args>
-        inline void info(const char* fmt, Args... args)
+        inline void info(fmt_string<Args...> fmt, const Args&... args)
         {
             pvt::print(this, LEVEL_INFO, fmt, args...);
         }
 
         template<typename... Args>
-        inline void debug(const char* fmt, Args... args)
+        inline void debug(fmt_string<Args...> fmt, const Args&... args)
         {
             if (!alog_is_print_debug())
             {
@@ -165,13 +859,13 @@ namespace alog
         }
 
         template<typename... Args>
-        inline void warning(const char* fmt, Args... args)
+        inline void warning(fmt_string<Args...> fmt, const Args&... args)
         {
             pvt::print(this, LEVEL_WARNING, fmt, args...);
         }
 
         template<typename... Args>
-        inline void error(const char* fmt, Args... args)
+        inline void error(fmt_string<Args...> fmt, const Args&... args)
         {
             pvt::print(this, LEVEL_ERROR, fmt, args...);
         }
@@ -193,7 +887,7 @@ namespace alog
 
     inline void setroot(const char* root, const char* process_flag)
     {
-        setroot(root, process_flag);
+        alog_setroot(root, process_flag);
     }
 
     inline void setoutdebug(bool v)
@@ -221,4 +915,84 @@ namespace alog
         return alog_get_error_count();
     }
 
+    inline void setsync(SyncMode mode, std::uint64_t ms = 1000, std::uint64_t bytes = 1024 * 1024)
+    {
+        alog_setsync(mode, ms, bytes);
+    }
+
+    // 二进制模式：INFO/WARNING的格式化移到日志线程，日志记录只含格式串地址与原始参数
+    inline void setbinary(bool v)
+    {
+        alog_setbinary(v);
+    }
+
+    // 调用点限流，默认不开启；开启后如setratelimit(100)：每调用点100条/秒、突发200条
+    //    （ERROR调用栈1秒内同一调用点只取一次，与是否限流无关）
+    inline void setratelimit(double per_sec, std::uint32_t burst = 200, std::uint64_t trace_ms = 1000)
+    {
+        alog_setratelimit(per_sec, burst, trace_ms);
+    }
+
+    // 日志队列字节预算（默认64MB）
+    inline void setbudget(std::uint64_t bytes, OverloadPolicy policy = OVERLOAD_DROP)
+    {
+        alog_setbudget(bytes, policy);
+    }
+
+    inline queue_stats getqueue()
+    {
+        queue_stats ret;
+        alog_getqueue(&ret);
+        return ret;
+    }
+
+    // 按大小切分（默认0：只按整点切分）
+    inline void setrotate(std::uint64_t max_bytes)
+    {
+        alog_setrotate(max_bytes);
+    }
+
+    // 日志保留策略（默认不清理）
+    inline void setretention(std::uint32_t max_files, std::uint64_t max_bytes = 0, std::uint64_t max_age_sec = 0)
+    {
+        alog_setretention(max_files, max_bytes, max_age_sec);
+    }
+
+    // 换出文件压缩（默认不压缩）
+    inline void setcompress(int level = 6, std::uint32_t cpu_percent = 20)
+    {
+        alog_setcompress(level, cpu_percent);
+    }
+
+    // 内存映射写（默认关闭）
+    inline void setmmap(std::uint64_t chunk_bytes = 4 * 1024 * 1024)
+    {
+        alog_setmmap(chunk_bytes);
+    }
+
+    inline void setlive(std::uint64_t bytes)
+    {
+        alog_setlive(bytes);
+    }
+
+    inline void setcrashdump(bool v)
+    {
+        alog_setcrashdump(v);
+    }
+
+    inline void setkvformat(KvFormat format)
+    {
+        alog_setkvformat(format);
+    }
+
+    inline void setsplitlevel(bool v)
+    {
+        alog_setsplitlevel(v);
+    }
+
+    inline void setring(std::uint64_t bytes, RingPolicy policy = RING_SPILL)
+    {
+        alog_setring(bytes, policy);
+    }
+
 }
@@ -0,0 +1,65 @@
+/********************************************************
+ *
+ * AA分布式引擎（C++）
+ *
+ * 日志共享内存环布局（进程内日志线程写，aalog-tail等外部工具只读）
+ *
+ * author: ygluu
+ *
+ * 2025 国庆
+ *
+ *******************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace alog
+{
+    namespace shm
+    {
+        // 共享内存对象名："/aalog.服务标志"（服务标志中的':'等已替换，见alog_setroot）
+        constexpr const char* name_prefix = "/aalog.";
+        constexpr std::uint32_t magic = 0x53474c41;     // "ALGS"
+        constexpr std::uint32_t version = 1;
+
+        // 对象布局：[header][data: capacity_字节]
+        //    写端（日志线程）每条记录：seq_变奇数 -> 必要时推进tail_pos_（覆盖最旧记录）-> 拷贝记录 -> 推进write_pos_ -> seq_变偶数
+        //    读端：读到偶数seq_后拷贝[cursor, write_pos_)，再读seq_，不等时重读tail_pos_，cursor仍不小于tail_pos_则拷贝有效
+        struct header
+        {
+            std::uint32_t magic_;
+            std::uint32_t version_;
+            std::uint64_t capacity_;                    // 数据区字节数，2的幂
+            std::uint64_t pid_;                         // 写端进程
+            char process_flag_[64];
+            alignas(64) std::atomic_uint64_t seq_;      // 顺序锁，奇数：写端正在写
+            std::atomic_uint64_t write_pos_;            // 已写字节（单调递增），数据区偏移为write_pos_ & (capacity_ - 1)
+            std::atomic_uint64_t tail_pos_;             // 最旧有效记录的位置
+            std::atomic_uint64_t count_;                // 已写记录数
+        };
+
+        // 每条记录8字节对齐，不跨越数据区结尾（尾部不够时写填充记录回绕）
+        struct record
+        {
+            std::uint32_t size_;                        // 记录总字节数（含本头）
+            std::uint8_t is_pad_;
+            std::uint8_t level_;                        // alog::LogLevel
+            std::uint16_t text_size_;
+            std::uint64_t tid_;
+            std::uint64_t time_;                        // 毫秒
+            char logger_[16];                           // 日志文件名（大写，如"SYS"、"LUA"）
+            char text_[0];                              // 日志内容（含结尾"\r\n"）
+        };
+
+        inline constexpr std::size_t record_size(std::size_t text_size)
+        {
+            return (sizeof(record) + text_size + 7) & ~std::size_t(7);
+        }
+
+        // 填充记录占满数据区尾部剩余，可短至8字节，只有size_、is_pad_有效
+        inline constexpr std::size_t min_pad_size = 8;
+    }
+}
@@ -156,14 +156,14 @@ namespace alua
     }
 
     template<typename... Args>
-    inline void info(const char* fmt, Args... args)
+    inline void info(alog::fmt_string<Args...> fmt, const Args&... args)
     {
         static auto lf = alua_getlogfile();
         alog::pvt::print(lf, alog::LEVEL_INFO, fmt, args...);
     }
 
     template<typename... Args>
-    inline void debug(const char* fmt, Args... args)
+    inline void debug(alog::fmt_string<Args...> fmt, const Args&... args)
     {
         if (!alog_is_print_debug())
         {
@@ -174,18 +174,35 @@ namespace alua
     }
 
     template<typename... Args>
-    inline void warning(const char* fmt, Args... args)
+    inline void warning(alog::fmt_string<Args...> fmt, const Args&... args)
     {
         static auto lf = alua_getlogfile();
         alog::pvt::print(lf, alog::LEVEL_WARNING, fmt, args...);
     }
 
     template<typename... Args>
-    inline void error(const char* fmt, Args... args)
+    inline void error(alog::fmt_string<Args...> fmt, const Args&... args)
     {
         static auto lf = alua_getlogfile();
-        auto s = std::string(fmt) + "\r\n" + currtraceback();
-        alog::pvt::print(lf, alog::LEVEL_ERROR, s.data(), args...);
+        int flags = alog::pvt::admit(lf, alog::LEVEL_ERROR, fmt);
+        if (!(flags & alog::ADMIT_PASS))
+        {
+            return;
+        }
+
+        char* buf_addr;
+        std::size_t buf_size;
+        alog_get_buf(&buf_addr, &buf_size);
+
+        // 调用栈不参与格式化，直接接在正文之后
+        auto txt_size = alog::pvt::format_to(buf_addr, buf_size, fmt, args...);
+        auto tb = currtraceback();
+        alog::pvt::writer w(buf_addr + txt_size, buf_size - txt_size - 1);
+        w.put("\r\n", 2);
+        w.put(tb.data(), tb.size());
+        txt_size = w.ptr() - buf_addr;
+        buf_addr[txt_size] = 0;
+        alog::pvt::submit(lf, alog::LEVEL_ERROR, buf_addr, txt_size, flags & alog::ADMIT_TRACE);
     }
 
     inline void require(const char* mod_name)
@@ -329,14 +346,102 @@ namespace alua
             }
         };
 
+        // 消息缓冲：Lua中为完整userdata（元表athd.abuf），只持有引用不复制消息体，回收时释放引用；
+        //    取参数时也接受字符串（复制一次）。方法：#buf、tostring(buf)、buf:str([i [, j]])（同string.sub，复制）
+        inline constexpr const char* abuf_meta = "athd.abuf";
+
+        inline athd::abuf* toabuf(lua_State* l, int i)
+        {
+            return static_cast<athd::abuf*>(luaL_testudata(l, i, abuf_meta));
+        }
+
+        inline int abuf_gc(lua_State* l)
+        {
+            auto b = toabuf(l, 1);
+            if (b)
+            {
+                b->~abuf();
+            }
+            return 0;
+        }
+
+        inline int abuf_len(lua_State* l)
+        {
+            auto b = static_cast<athd::abuf*>(luaL_checkudata(l, 1, abuf_meta));
+            lua_pushinteger(l, static_cast<lua_Integer>(b->size()));
+            return 1;
+        }
+
+        inline int abuf_str(lua_State* l)
+        {
+            auto b = static_cast<athd::abuf*>(luaL_checkudata(l, 1, abuf_meta));
+            auto size = static_cast<lua_Integer>(b->size());
+            auto i = luaL_optinteger(l, 2, 1);
+            auto j = luaL_optinteger(l, 3, -1);
+            i = i < 0 ? (i < -size ? 1 : size + i + 1) : (i == 0 ? 1 : i);
+            j = j < 0 ? size + j + 1 : (j > size ? size : j);
+            if (i > j)
+            {
+                lua_pushliteral(l, "");
+            }
+            else
+            {
+                lua_pushlstring(l, b->data() + i - 1, static_cast<std::size_t>(j - i + 1));
+            }
+            return 1;
+        }
+
+        template<> struct pusher<athd::abuf>
+        {
+            static void put(lua_State* l, const athd::abuf& v)
+            {
+                new (lua_newuserdatauv(l, sizeof(athd::abuf), 0)) athd::abuf(v);
+                if (luaL_newmetatable(l, abuf_meta))
+                {
+                    static const luaL_Reg metas[] = {
+                        {"__gc", abuf_gc},
+                        {"__len", abuf_len},
+                        {"__tostring", abuf_str},
+                        {NULL, NULL}
+                    };
+                    static const luaL_Reg methods[] = {
+                        {"str", abuf_str},
+                        {"size", abuf_len},
+                        {NULL, NULL}
+                    };
+                    luaL_setfuncs(l, metas, 0);
+                    luaL_newlib(l, methods);
+                    lua_setfield(l, -2, "__index");
+                }
+                lua_setmetatable(l, -2);
+            }
+        };
+
+        template<> struct popper<athd::abuf>
+        {
+            static athd::abuf get(lua_State* l, int i)
+            {
+                auto b = toabuf(l, i);
+                if (b)
+                {
+                    return *b;
+                }
+                std::size_t len;
+                auto s = luaL_checklstring(l, i, &len);
+                return athd::abuf(s, len);
+            }
+        };
+        template<> struct popper<const athd::abuf&> : popper<athd::abuf> {};
+
         // 压栈
         template<> struct pusher<int>           { static void put(lua_State* l,int v){lua_pushinteger(l,v);}};
         template<> struct pusher<float>         { static void put(lua_State* l,float v){lua_pushnumber(l,v);}};
         template<> struct pusher<double>        { static void put(lua_State* l,double v){lua_pushnumber(l,v);}};
         template<> struct pusher<bool>          { static void put(lua_State* l,bool v){lua_pushboolean(l,v);}};
         template<> struct pusher<std::uint32_t> { static void put(lua_State* l,std::uint32_t v){lua_pushnumber(l,v);}};
-        template<> struct pusher<std::uint64_t> { static void put(lua_State* l,std::uint64_t v){lua_pushnumber(l,v);}};
-        template<> struct pusher<std::int64_t>  { static void put(lua_State* l,std::int64_t v){lua_pushnumber(l,v);}};
+        // 64位整数按Lua整数压栈（ID等超过2^53的值按浮点数会丢精度）
+        template<> struct pusher<std::uint64_t> { static void put(lua_State* l,std::uint64_t v){lua_pushinteger(l,static_cast<lua_Integer>(v));}};
+        template<> struct pusher<std::int64_t>  { static void put(lua_State* l,std::int64_t v){lua_pushinteger(l,v);}};
         template<> struct pusher<std::string>   { static void put(lua_State* l,const std::string& v){lua_pushlstring(l,v.data(),v.size());}};
         template<> struct pusher<const char*>   { static void put(lua_State* l,const char* v){lua_pushstring(l,v);}};
         template<> struct pusher<void*>         { static void put(lua_State* l,void* v){lua_pushlightuserdata(l,v);}};
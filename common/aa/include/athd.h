@@ -31,8 +31,14 @@
 #include <functional>
 #include <cstdint>
 #include <atomic>
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <new>
+#include <stdexcept>
 
 #include "aos.h"
+#include "atype.h"
 
 extern "C"
 {
@@ -47,6 +53,26 @@ extern "C"
 		uint64_t job_count_;
 	};
 
+	// 压入作业的可选项
+	struct job_opt
+	{
+		void* token_ = nullptr;		// 取消令牌（athd_newtoken），令牌被取消后未执行的作业直接回执
+		uint64_t deadline_ = 0;		// 绝对截止时间（atime::nsec()），过期未执行的作业直接回执，0：不限
+	};
+
+	// 线程作业统计
+	struct thread_stats
+	{
+		uint64_t exec_count_ = 0;		// 已执行作业数
+		uint64_t cancel_count_ = 0;		// 已取消（未执行）作业数
+		uint64_t shed_count_ = 0;		// 超过截止时间被丢弃（未执行）作业数
+		uint64_t pending_count_ = 0;	// 当前排队作业数
+		uint64_t tick_count_ = 0;		// 定帧模式：已执行帧数
+		uint64_t overrun_count_ = 0;	// 定帧模式：帧耗时超过周期的次数
+		uint64_t skip_count_ = 0;		// 定帧模式：落后而跳过的帧数
+		uint64_t max_frame_ns_ = 0;		// 定帧模式：最大帧耗时（纳秒）
+	};
+
 }
 
 AA_API void* athd_getresult(void);
@@ -58,17 +84,43 @@ AA_API void* athd_newpool(const char* name, std::size_t num, c_tfunc tfunc, void
 AA_API void* athd_getct(void);
 AA_API std::uint64_t athd_getctid();
 AA_API void* athd_getmain();
+// done_fn可为空：作业执行后不回送结果（job_ptr由调用方管理，不回收）
 AA_API void  athd_pushtjob(void* t,
 				const char* job_name,
 				void* job_ptr,
 				c_twork work_fn,
-				c_tdone done_fn);
+				c_tdone done_fn,
+				const job_opt* opt = nullptr);
 AA_API void  athd_pushpjob(void* pool,
 				const char* job_name,
 				std::uint64_t cid,
 				void* job_ptr,
 				c_twork work_fn,
-				c_tdone done_fn);
+				c_tdone done_fn,
+				const job_opt* opt = nullptr);
+
+// 取消令牌：共享的纪元计数，压入时记录纪元，执行前纪元已变化则视为取消
+AA_API void* athd_newtoken(void);
+AA_API void  athd_reftoken(void* token);
+AA_API void  athd_unreftoken(void* token);
+AA_API void  athd_canceltoken(void* token);
+// 取消线程池中指定一致性ID已压入且尚未执行的全部作业
+AA_API void  athd_cancelpjobs(void* pool, std::uint64_t cid);
+// 当前回执的作业状态（在回执函数中调用），见athd::JobStatus
+AA_API int   athd_getstatus(void);
+// 截止时间优先（EDF）：线程每批作业按截止时间排序执行，无截止时间的排在后面，tp为空即当前线程
+AA_API void  athd_setedf(void* tp, bool v);
+// 线程作业统计，tp为空即当前线程
+AA_API void  athd_getstats(void* tp, thread_stats* out);
+// 线程当前排队作业数（只读一个原子量，供发送方均衡选择目标），tp为空即当前线程
+AA_API std::uint64_t athd_getpending(void* tp);
+// 定帧模式：每ms毫秒在线程中调用一次fn(data)，帧间继续处理作业，tp为空即当前线程
+//    budget：两次检查帧之间最多执行的作业数，0：不限；ms为0恢复事件驱动
+//    free_fn非空时data归线程所有：被再次设置替换、线程结束时由线程自己调用free_fn(data)释放
+AA_API void  athd_settick(void* tp, std::uint64_t ms, int budget, c_twork fn, void* data, c_twork free_fn = nullptr);
+// 消息缓冲：按大小分级的池，任意线程分配/释放，适合被多个线程持有、生命期不定的缓冲（见athd::abuf）
+AA_API void* athd_mbufalloc(std::size_t size);
+AA_API void  athd_mbuffree(void* p);
 
 // 直接对外的接口
 AA_API void  athd_setjobcapecity(std::size_t v);	
@@ -84,6 +136,14 @@ AA_API int athd_getpoolthreads(void* pool, void** threads, std::size_t* size);
 // ---------------------------------------------------------------------------
 namespace athd
 {
+	// 作业状态（回执函数中通过getstatus获取）
+	enum JobStatus
+	{
+		STATUS_OK = 0,			// 正常执行完成
+		STATUS_CANCELLED,		// 已取消，作业函数未执行
+		STATUS_TIMEOUT			// 超过截止时间，作业函数未执行
+	};
+
 	namespace pvt
 	{
 		using tfunc = std::function<void()>;
@@ -205,6 +265,173 @@ namespace athd
 		}
 	} // 匿名 namespace
 
+	// -----------------------------------------------------------------------
+	//  取消令牌（引用计数，可复制）
+	//    会话断开、实体销毁时调用cancel，此前带本令牌压入且尚未执行的作业
+	//    跳过作业函数直接回执，回执中getstatus()返回STATUS_CANCELLED
+	// -----------------------------------------------------------------------
+	class token final
+	{
+	public:
+		token()
+		{
+			ptr_ = athd_newtoken();
+		}
+
+		token(const token& other)
+		{
+			ptr_ = other.ptr_;
+			athd_reftoken(ptr_);
+		}
+
+		token& operator=(const token& other)
+		{
+			if (this == &other)
+			{
+				return *this;
+			}
+			athd_reftoken(other.ptr_);
+			athd_unreftoken(ptr_);
+			ptr_ = other.ptr_;
+			return *this;
+		}
+
+		~token()
+		{
+			athd_unreftoken(ptr_);
+		}
+
+		// 取消此前压入的作业，之后再压入的作业不受影响（令牌可继续使用）
+		inline void cancel()
+		{
+			athd_canceltoken(ptr_);
+		}
+
+		inline job_opt opt() const
+		{
+			job_opt ret;
+			ret.token_ = ptr_;
+			return ret;
+		}
+
+	private:
+		void* ptr_ = nullptr;
+	};
+
+	// -----------------------------------------------------------------------
+	//  引用计数缓冲（单指针），数据在分级消息缓冲池中（athd_mbufalloc）
+	//    复制只增加引用，可直接作为atype::abuf使用，适合跨线程投递、多个接收者共享的消息/参数
+	// -----------------------------------------------------------------------
+	class abuf final
+	{
+	public:
+		abuf() = default;
+
+		abuf(const char* data, std::size_t size)
+		{
+			h_ = alloc_head(size);
+			if (size)
+			{
+				std::memcpy(wdata(), data, size);
+			}
+		}
+
+		explicit abuf(atype::abuf v) : abuf(v.data(), v.size())
+		{
+		}
+
+		abuf(const abuf& other) noexcept
+		{
+			h_ = other.h_;
+			if (h_)
+			{
+				h_->ref_count_.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		abuf(abuf&& other) noexcept
+		{
+			h_ = other.h_;
+			other.h_ = nullptr;
+		}
+
+		abuf& operator=(const abuf& other) noexcept
+		{
+			abuf tmp(other);
+			std::swap(h_, tmp.h_);
+			return *this;
+		}
+
+		abuf& operator=(abuf&& other) noexcept
+		{
+			std::swap(h_, other.h_);
+			return *this;
+		}
+
+		~abuf()
+		{
+			if (h_ && h_->ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				h_->~head();
+				athd_mbuffree(h_);
+			}
+		}
+
+		// 分配size字节未初始化的缓冲，由wdata()填写后再投递
+		static inline abuf alloc(std::size_t size)
+		{
+			abuf ret;
+			ret.h_ = alloc_head(size);
+			return ret;
+		}
+
+		inline const char* data() const
+		{
+			return h_ ? reinterpret_cast<const char*>(h_ + 1) : "";
+		}
+
+		inline char* wdata()
+		{
+			return h_ ? reinterpret_cast<char*>(h_ + 1) : nullptr;
+		}
+
+		inline std::size_t size() const
+		{
+			return h_ ? h_->size_ : 0;
+		}
+
+		inline bool empty() const
+		{
+			return size() == 0;
+		}
+
+		inline operator atype::abuf() const
+		{
+			return atype::abuf(data(), size());
+		}
+
+	private:
+		struct head
+		{
+			std::atomic_int ref_count_{1};
+			std::size_t size_ = 0;
+		};
+
+		static inline head* alloc_head(std::size_t size)
+		{
+			auto p = athd_mbufalloc(sizeof(head) + size);
+			if (!p)
+			{
+				throw std::bad_alloc();
+			}
+			auto h = new (p) head();
+			h->size_ = size;
+			return h;
+		}
+
+		head* h_ = nullptr;
+	};
+
 	// -----------------------------------------------------------------------
 	//  单线程封装
 	// -----------------------------------------------------------------------
@@ -216,6 +443,12 @@ namespace athd
 		{
 			athd_pushtjob(this, job_name, pvt::alloc_job(w, d), pvt::thread_work, pvt::thread_done);
 		}
+
+		// 将任务压入当前线程（带可选项，如取消令牌）
+		inline void pushjob(const char* job_name, const pvt::tfunc& w, const pvt::tfunc& d, const job_opt& opt)
+		{
+			athd_pushtjob(this, job_name, pvt::alloc_job(w, d), pvt::thread_work, pvt::thread_done, &opt);
+		}
 	};
 
 	// 创建线程
@@ -241,6 +474,64 @@ namespace athd
 		return athd_jobend();
 	}
 
+	// 当前回执的作业状态，见JobStatus
+	inline int getstatus()
+	{
+		return athd_getstatus();
+	}
+
+	// 截止时间选项：now_ns为atime::nsec()，ms毫秒后过期
+	inline job_opt deadline(std::uint64_t now_ns, std::uint64_t ms)
+	{
+		job_opt ret;
+		ret.deadline_ = now_ns + ms * 1000000;
+		return ret;
+	}
+
+	inline void setedf(thread* t, bool v)
+	{
+		athd_setedf(t, v);
+	}
+
+	inline thread_stats getstats(thread* t = nullptr)
+	{
+		thread_stats ret;
+		athd_getstats(t, &ret);
+		return ret;
+	}
+
+	inline std::uint64_t getpending(thread* t = nullptr)
+	{
+		return athd_getpending(t);
+	}
+
+	namespace pvt
+	{
+		static void tick_func(void* p)
+		{
+			(*static_cast<tfunc*>(p))();
+		}
+
+		static void tick_free(void* p)
+		{
+			delete static_cast<tfunc*>(p);
+		}
+	}
+
+	// 定帧模式（请在初始化阶段为每个线程设置一次）
+	//    t：线程，空即当前线程
+	//    ms：帧周期，毫秒
+	//    budget：两次检查帧之间最多执行的作业数，0：不限
+	inline void settick(thread* t, std::uint64_t ms, int budget, const pvt::tfunc& fn)
+	{
+		if (!ms || !fn)
+		{
+			athd_settick(t, ms, budget, nullptr, nullptr);
+			return;
+		}
+		athd_settick(t, ms, budget, pvt::tick_func, new pvt::tfunc(fn), pvt::tick_free);
+	}
+
 	//  获取当前线程
 	inline thread* getct()
 	{
@@ -311,6 +602,22 @@ namespace athd
 			athd_pushpjob(this, job_name, cid, pvt::alloc_job(w, d), pvt::thread_work, pvt::thread_done);
 		}
 
+		// 向并发线程池推送任务（带可选项，如取消令牌）
+		inline void pushjob(const char* job_name,
+		                     const pvt::tfunc& w,
+							 const pvt::tfunc& d,
+		                     std::uint64_t cid,
+							 const job_opt& opt)
+		{
+			athd_pushpjob(this, job_name, cid, pvt::alloc_job(w, d), pvt::thread_work, pvt::thread_done, &opt);
+		}
+
+		// 取消指定一致性ID已压入且尚未执行的全部作业（回执状态为STATUS_CANCELLED）
+		inline void cancel(std::uint64_t cid)
+		{
+			athd_cancelpjobs(this, cid);
+		}
+
 		// 查询指定一致性ID的未决任务数，0：为threads的所有未决作业任务总和
 		inline int pending(std::uint64_t cid = 0)
 		{
@@ -345,4 +652,251 @@ namespace athd
 		return ret;
 	}
 
+	// -----------------------------------------------------------------------
+	//  作业图（DAG）
+	//    节点绑定线程或线程池（cid），edge声明依赖，run后入度归零的节点
+	//    立即派发到所属线程执行，全部节点完成后在发起run的线程回调done
+	//    拓扑不变时可重复run（如每帧更新），派发复用节点自带的作业记录，不分配作业对象
+	//  例：
+	//    athd::graph g;
+	//    auto cfg = g.add("load_cfg", io_thd, load_cfg);
+	//    auto idx = g.add("build_idx", pool, 1, build_idx);
+	//    auto hot = g.add("warm_cache", pool, 2, warm_cache);
+	//    g.edge(cfg, idx);
+	//    g.edge(cfg, hot);
+	//    g.run([]{ start_listen(); });
+	// -----------------------------------------------------------------------
+	class graph final
+	{
+	public:
+		using nid = std::size_t;
+
+		graph()
+		{
+			done_job_.graph_ = this;
+			done_job_.id_ = done_id;
+		}
+		graph(const graph&) = delete;
+		graph& operator=(const graph&) = delete;
+
+		// 添加绑定到线程的节点
+		inline nid add(const char* name, thread* t, const pvt::tfunc& fn)
+		{
+			if (!t)
+			{
+				throw std::runtime_error("graph::add：线程不能为空");
+			}
+			auto& n = new_node(name);
+			n.thread_ = t;
+			n.fn_ = fn;
+			return n.job_.id_;
+		}
+
+		// 添加绑定到线程池的节点，cid同pool::pushjob
+		inline nid add(const char* name, pool* p, std::uint64_t cid, const pvt::tfunc& fn)
+		{
+			if (!p)
+			{
+				throw std::runtime_error("graph::add：线程池不能为空");
+			}
+			auto& n = new_node(name);
+			n.pool_ = p;
+			n.cid_ = cid;
+			n.fn_ = fn;
+			return n.job_.id_;
+		}
+
+		// from完成后才执行to
+		inline void edge(nid from, nid to)
+		{
+			if (from >= nodes_.size() || to >= nodes_.size())
+			{
+				throw std::runtime_error("graph::edge：无效节点");
+			}
+			nodes_[from].succ_.push_back(to);
+			nodes_[to].preds_++;
+			dirty_ = true;
+		}
+
+		// 运行作业图（须在athd线程中调用）
+		//    返回false：正在运行、存在环或当前非athd线程
+		inline bool run(const pvt::tfunc& done = nullptr)
+		{
+			auto owner = getct();
+			if (!owner || running_.exchange(true))
+			{
+				return false;
+			}
+			if (dirty_)
+			{
+				if (has_cycle())
+				{
+					running_ = false;
+					return false;
+				}
+				dirty_ = false;
+			}
+
+			owner_ = owner;
+			done_ = done;
+			if (nodes_.empty())
+			{
+				finish();
+				return true;
+			}
+
+			remain_ = (int)nodes_.size();
+			for (auto& n : nodes_)
+			{
+				n.pending_.store(n.preds_, std::memory_order_relaxed);
+			}
+			for (nid id = 0; id < nodes_.size(); ++id)
+			{
+				if (!nodes_[id].preds_)
+				{
+					dispatch(id);
+				}
+			}
+			return true;
+		}
+
+		inline bool running() const
+		{
+			return running_;
+		}
+
+		inline std::size_t size() const
+		{
+			return nodes_.size();
+		}
+
+	private:
+		static constexpr nid done_id = ~nid(0);
+
+		// 节点的作业记录，随节点一起分配，每次run重复压入（头部与pvt::job相同）
+		struct gjob : job_base
+		{
+			graph* graph_ = nullptr;
+			nid id_ = 0;
+		};
+
+		struct gnode
+		{
+			gjob job_;
+			const char* name_ = "";
+			thread* thread_ = nullptr;
+			pool* pool_ = nullptr;
+			std::uint64_t cid_ = 0;
+			pvt::tfunc fn_;
+			std::vector<nid> succ_;
+			int preds_ = 0;
+			std::atomic_int pending_{0};
+		};
+
+		inline gnode& new_node(const char* name)
+		{
+			auto& n = nodes_.emplace_back();
+			n.job_.graph_ = this;
+			n.job_.id_ = nodes_.size() - 1;
+			n.name_ = name;
+			dirty_ = true;
+			return n;
+		}
+
+		static void node_work(void* job_ptr)
+		{
+			auto j = static_cast<gjob*>(job_ptr);
+			if (j->id_ == done_id)
+			{
+				j->graph_->finish();
+				return;
+			}
+			j->graph_->exec(j->id_);
+		}
+
+		// 压入节点自带的作业记录，无回执：派发不分配作业对象、不复制std::function
+		inline void dispatch(nid id)
+		{
+			auto& n = nodes_[id];
+			if (n.pool_)
+			{
+				athd_pushpjob(n.pool_, n.name_, n.cid_, &n.job_, node_work, nullptr);
+			}
+			else
+			{
+				athd_pushtjob(n.thread_, n.name_, &n.job_, node_work, nullptr);
+			}
+		}
+
+		inline void exec(nid id)
+		{
+			auto& n = nodes_[id];
+			if (n.fn_)
+			{
+				n.fn_();
+			}
+			for (auto s : n.succ_)
+			{
+				if (nodes_[s].pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					dispatch(s);
+				}
+			}
+			if (remain_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				athd_pushtjob(owner_, "graph.done", &done_job_, node_work, nullptr);
+			}
+		}
+
+		inline void finish()
+		{
+			auto done = std::move(done_);
+			done_ = nullptr;
+			running_ = false;
+			if (done)
+			{
+				done();
+			}
+		}
+
+		// Kahn算法检查环
+		inline bool has_cycle()
+		{
+			std::vector<int> degree(nodes_.size());
+			std::vector<nid> ready;
+			for (nid id = 0; id < nodes_.size(); ++id)
+			{
+				degree[id] = nodes_[id].preds_;
+				if (!degree[id])
+				{
+					ready.push_back(id);
+				}
+			}
+			std::size_t visited = 0;
+			while (!ready.empty())
+			{
+				auto id = ready.back();
+				ready.pop_back();
+				visited++;
+				for (auto s : nodes_[id].succ_)
+				{
+					if (!--degree[s])
+					{
+						ready.push_back(s);
+					}
+				}
+			}
+			return visited != nodes_.size();
+		}
+
+	private:
+		std::deque<gnode> nodes_;
+		thread* owner_ = nullptr;
+		gjob done_job_;			// 全部完成后压回发起线程的作业记录
+		pvt::tfunc done_;
+		std::atomic_int remain_{0};
+		std::atomic_bool running_{false};
+		bool dirty_ = false;
+	};
+
 }
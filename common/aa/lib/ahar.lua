@@ -13,21 +13,23 @@ if ahar == nil then
     ahar = {}
 end
 
+local mp = require "cmsgpack"
+local mp_encode = mp.pack
+local mp_decode = mp.unpack
 local pb_encode = function (name, msg)
-    return ahar.mp.pack(msg)
+    return mp_encode(msg)
 end
 local pb_decode = function (name, buf)
-    return ahar.mp.unpack(buf)
+    return mp_decode(buf)
 end
-local mp = "cmsgpack"
-local mp_encode = mp.pack
-local mp_decode = mp.unpack
 
 local regmsg = ahar.regmsg
 local listen = ahar.listen
 local leavect = ahar.leavect
 local enterct = ahar.enterct
+local setbalance = ahar.setbalance
 local send = ahar.send
+local sendby = ahar.sendby
 local send_cross = ahar.send_cross
 local sendto = ahar.sendto
 local sendto_cross = ahar.sendto_cross
@@ -42,6 +44,16 @@ local groupadd = ahar.groupadd
 local groupdel = ahar.groupdel
 local groupclear = ahar.groupclear
 local groupsend = ahar.groupsend
+local reply = ahar.reply
+
+--- call应答状态（ahar.call等回调的第二个参数）
+ahar.RPC_OK = 0
+ahar.RPC_TIMEOUT = 1    --- 超时未应答
+ahar.RPC_NOROUTE = 2    --- 没有处理者，未发出
+--- call默认超时（毫秒）
+ahar.call_timeout = 30000
+
+local calls = {}        --- cid -> 回调，本线程发起、尚未应答的call
 
 local function chech_regmsg(name, type)
     local mis = ahar.msg_info_by_name;
@@ -86,46 +98,55 @@ local function encode(name, p1, ...)
     return mi.mid, buf
 end
 
-function ahar.on_buf(mid, buf, sender)
+local function decode(mi, buf)
+    if not buf or #buf == 0 then
+        return {n = 0}
+    end
+    if mi.type == 1 then
+        return {pb_decode(mi.name, buf:str()), n = 1}
+    end
+    return mp_decode(buf:str())
+end
+
+--- @brief 收到消息，buf为athd.abuf（各接收线程共享，不复制），解码时才取出内容
+---     cid非0为call请求：只交给第一个回调，其返回值即应答（在本线程发回）
+function ahar.on_buf(mid, buf, cid)
     local mi = ahar.msg_info_by_id[mid]
     if not mi then
         return
     end
-    if mi.type == 1 then
-        local msg
-        if buf then      
-            pb_decode(mi.name, buf)
-        end
-        for _, cb in ipairs(mi.cbs) do
-            if sender then
-                cb(sender, msg)
-            else
-                cb(msg)
-            end            
-        end
-    else
-        local msg
-        if buf and #buf > 0 then
-            msg = mp_decode(buf)
-        end
-        for _, cb in ipairs(mi.cbs) do
-            if sender then
-                if msg then
-                    cb(sender, table.unpack(msg))
-                else
-                    cb(sender)
-                end
-            else
-                if msg then
-                    cb(table.unpack(msg))
-                else
-                    cb()
-                end
-            end
-        end
+    if #mi.cbs == 0 then
+        return
+    end
+    local msg = decode(mi, buf)
+    if cid ~= 0 then
+        local rv = table.pack(mi.cbs[1](table.unpack(msg, 1, msg.n or #msg)))
+        reply(cid, mp_encode(rv))
+        return
+    end
+    for _, cb in ipairs(mi.cbs) do
+        cb(table.unpack(msg, 1, msg.n or #msg))
     end
 end
 
+--- @brief call应答（由libaa.so在发起线程调用），回调cb(ok, status或应答值...)
+function ahar.on_resp(cid, status, buf)
+    local cb = calls[cid]
+    if not cb then
+        return
+    end
+    calls[cid] = nil
+    if status ~= ahar.RPC_OK then
+        cb(false, status)
+        return
+    end
+    local rv = {n = 0}
+    if buf and #buf > 0 then
+        rv = mp_decode(buf:str())
+    end
+    cb(true, table.unpack(rv, 1, rv.n or #rv))
+end
+
 --- @brief 注册protobuf消息，其它消息无需注册默认使用cmsgpack格式
 function ahar.regpb(name)
     chech_regmsg(name, 1)
@@ -134,7 +155,10 @@ end
 function ahar.listen(name, cb)
     local mi = chech_regmsg(name, 0)
     table.insert(mi.cbs, cb)
-    listen(name)
+    -- 每个线程只向libaa.so登记一次，收到后由on_buf分发给各回调
+    if #mi.cbs == 1 then
+        listen(name)
+    end
 end
 
 --- @brief 对象离开当前线程
@@ -149,7 +173,18 @@ function ahar.enterct(oid)
     enterct(oid)
 end
 
---- @brief 发消息，如果有多个进程接收则轮询均衡
+--- send的均衡方式（ahar.setbalance）
+ahar.BALANCE_ROUND_ROBIN = 0    --- 轮询（默认）
+ahar.BALANCE_LEAST_PENDING = 1  --- 投给排队作业最少的线程
+ahar.BALANCE_STICKY = 2         --- 按key一致性哈希（ahar.sendby），相同key总到同一线程
+
+--- @brief 设置消息在多个接收线程间的均衡方式
+function ahar.setbalance(name, mode)
+    assert(chech_regmsg(name, 0), name)
+    setbalance(name, mode)
+end
+
+--- @brief 发消息，有多个线程接收时按setbalance设置的方式均衡（默认轮询）
 ---     可以是单个msg对象也可以是不定长参数
 ---     收发双方协商消息/参数格式
 function ahar.send(name, p1, ...)
@@ -160,6 +195,15 @@ function ahar.send(name, p1, ...)
     send(mid, buf)
 end
 
+--- @brief 同send，均衡方式为BALANCE_STICKY时相同key总投给同一线程
+function ahar.sendby(key, name, p1, ...)
+    local mid, buf = encode(name, p1, ...)
+    if not mid then
+        return
+    end
+    sendby(key, mid, buf)
+end
+
 function ahar.send_cross(name, p1, ...)
     local mid, buf = encode(name, p1, ...)
     if not mid then
@@ -185,31 +229,41 @@ function ahar.sendto_cross(rid, name, p1, ...)
     sendto_cross(rid, mid, buf)
 end
 
---- @brief 发送call消息，在回调函数(cb)接收返回消息
+local function track_call(cid, cb)
+    if cid ~= 0 then
+        calls[cid] = cb
+    end
+    return cid
+end
+
+--- @brief 发送call消息，在回调函数cb(ok, ...)接收应答：成功时ok为true，其后为对方处理函数的返回值；
+---     失败时ok为false，其后为ahar.RPC_TIMEOUT/RPC_NOROUTE；返回关联ID
+---     有多个线程接收时按setbalance设置的方式选一个
 function ahar.call(name, cb, p1, ...)
     local mid, buf = encode(name, p1, ...)
     if not mid then
         return
     end
-    call(cb, mid, buf)
+    return track_call(call(mid, buf, ahar.call_timeout), cb)
 end
 
+--- @brief 跨进程call：传输尚未实现，cb总是收到(false, ahar.RPC_NOROUTE)
 function ahar.call_cross(name, cb, p1, ...)
     local mid, buf = encode(name, p1, ...)
     if not mid then
         return
     end
-    call_cross(cb, mid, buf)
+    return track_call(call_cross(mid, buf, ahar.call_timeout), cb)
 end
 
 --- @brief 向rid所在线程发送call消息，
----     在回调函数(cb)接收返回消息
+---     在回调函数(cb)接收返回消息，同ahar.call
 function ahar.callto(rid, name, cb, p1, ...)
     local mid, buf = encode(name, p1, ...)
     if not mid then
         return
     end
-    callto(0, rid, cb, mid, buf)
+    return track_call(callto(rid, mid, buf, ahar.call_timeout), cb)
 end
 
 function ahar.callto_cross(rid, name, cb, p1, ...)
@@ -217,7 +271,7 @@ function ahar.callto_cross(rid, name, cb, p1, ...)
     if not mid then
         return
     end
-    callto_cross(1, rid, cb, mid, buf)
+    return track_call(callto_cross(rid, mid, buf, ahar.call_timeout), cb)
 end
 
 function ahar.svcbc(name, p1, ...)
@@ -225,7 +279,7 @@ function ahar.svcbc(name, p1, ...)
     if not mid then
         return
     end
-    svcbc(0, false, mid, buf)
+    svcbc(mid, buf)
 end
 
 function ahar.svcbc_cross(name, p1, ...)
@@ -233,7 +287,7 @@ function ahar.svcbc_cross(name, p1, ...)
     if not mid then
         return
     end
-    svcbc_cross(1, false, mid, buf)
+    svcbc_cross(mid, buf)
 end
 
 function ahar.gatebc(name, p1, ...)
@@ -241,7 +295,7 @@ function ahar.gatebc(name, p1, ...)
     if not mid then
         return
     end
-    gatebc(0, true, mid, buf)
+    gatebc(mid, buf)
 end
 
 function ahar.groupadd(gid, mid)
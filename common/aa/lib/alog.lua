@@ -7,12 +7,34 @@ local info = alog.info
 local debug = alog.debug
 local waring = alog.waring
 local error = alog.error
+local kv = alog.kv
+local setkvformat = alog.setkvformat
 local setroot = alog.setroot
 local setoutdebug = alog.setoutdebug
 local print_screen = alog.print_screen
 local print_syslog = alog.print_syslog
 local print_stack = alog.print_stack
 local addfile = alog.addfile
+local setsync = alog.setsync
+local setsplitlevel = alog.setsplitlevel
+local setring = alog.setring
+local setbinary = alog.setbinary
+local setratelimit = alog.setratelimit
+local setbudget = alog.setbudget
+local setrotate = alog.setrotate
+local setretention = alog.setretention
+local setcompress = alog.setcompress
+local setmmap = alog.setmmap
+local setcrashdump = alog.setcrashdump
+local setlive = alog.setlive
+local getqueue = alog.getqueue
+local getdrops = alog.getdrops
+
+local sync_modes = {none = 0, interval = 1, error = 2}
+local ring_policies = {block = 0, drop = 1, spill = 2}
+local overload_policies = {drop = 0, block = 1}
+local kv_levels = {info = 0, debug = 1, warning = 2, error = 3}
+local kv_formats = {json = 0, logfmt = 1}
 
 -- 输出调试日志，默认不输出，参阅setoutdebug
 -- @param args 不定长参数，number/string/bool输出原值，其它输出对象地址
@@ -54,6 +76,23 @@ function alog.error_fmt(fmt, ...)
     error(string.format(fmt, ...))
 end
 
+-- 输出结构化日志，一行JSON或logfmt（见setkvformat），写入lua日志文件
+-- 如：alog.kv("info", "login", {uid = 1001, ms = 3.5}) => {"event":"login","uid":1001,"ms":3.5}
+-- @param level string info/debug/warning/error
+-- @param event string 事件名，同一事件名共用一个限流调用点
+-- @param fields table 字段表，仅取字符串键，number/string/bool输出原值，其它输出对象地址
+function alog.kv(level, event, fields)
+    local v = assert(kv_levels[level], "alog.kv：未知的日志等级 " .. tostring(level))
+    kv(v, event, fields)
+end
+
+-- 设置结构化日志编码格式，默认json
+-- @param format string json：{"event":"login","uid":1001}，logfmt：event=login uid=1001
+function alog.setkvformat(format)
+    local v = assert(kv_formats[format], "alog.setkvformat：未知的格式 " .. tostring(format))
+    setkvformat(v)
+end
+
 -- 设置日志根目录和服务标志
 -- 日志目录：root/svc_flag/..._info.log
 -- 如：root/agame/2025-10-05-21_agame_sys_info.log (svc_flag = agame, 最好带ip:port，分布式多实例时agame有多个)
@@ -93,3 +132,102 @@ end
 function alog.addfile(v)
     addfile(v)
 end
+
+-- 设置日志落盘策略，默认interval（1000毫秒/1MB）
+-- 日志线程每批日志每个文件只写一次，再按策略fsync
+-- @param mode string none：不主动落盘（页缓存回写），interval：按时间/字节落盘，error：仅含ERROR的批次落盘
+-- @param ms number interval的时间阈值（毫秒），可选
+-- @param bytes number interval的字节阈值，可选
+function alog.setsync(mode, ms, bytes)
+    local v = assert(sync_modes[mode], "alog.setsync：未知的落盘策略 " .. tostring(mode))
+    setsync(v, ms or 1000, bytes or 1024 * 1024)
+end
+
+-- 设置各等级是否分文件，默认分文件（..._info.log/..._error.log），请在setroot前设置
+-- @param v bool true: 分文件，false: 所有等级写入同一个..._all.log
+function alog.setsplitlevel(v)
+    setsplitlevel(v)
+end
+
+-- 设置二进制模式：C++侧INFO/WARNING日志只记录格式串地址与原始参数，由日志线程格式化
+-- Lua日志在Lua侧已拼成字符串，不受影响
+-- @param v bool
+function alog.setbinary(v)
+    setbinary(v)
+end
+
+-- 开启调用点限流（默认不限流；C++按格式串、Lua按源码行区分调用点），超出的日志丢弃，每秒输出一条“(repeated N times)”汇总
+-- @param per_sec number 每个调用点每秒条数，不传为100，0关闭限流
+-- @param burst number 突发条数，默认200
+-- @param trace_ms number C++ ERROR日志同一调用点取调用栈的最小间隔（毫秒），默认1000，0每次都取
+function alog.setratelimit(per_sec, burst, trace_ms)
+    setratelimit(per_sec or 100, burst or 200, trace_ms or 1000)
+end
+
+-- 设置日志队列字节预算：排队超过预算3/4丢弃DEBUG/INFO，超过预算时WARNING等待或丢弃，ERROR始终保留
+-- 丢弃情况每秒汇总一条写入系统日志
+-- @param bytes number 预算字节数，默认64MB，0不限
+-- @param policy string WARNING超预算时：drop丢弃（默认），block等待
+function alog.setbudget(bytes, policy)
+    local v = assert(overload_policies[policy or "drop"], "alog.setbudget：未知的策略 " .. tostring(policy))
+    setbudget(bytes, v)
+end
+
+-- 设置按大小切分：文件达到max_bytes后切到同一小时的下一个分片（..._info.1.log、..._info.2.log…）
+-- @param max_bytes number 单个文件字节上限，0只按整点切分（默认）
+function alog.setrotate(max_bytes)
+    setrotate(max_bytes or 0)
+end
+
+-- 设置日志保留策略：后台低优先级线程从最旧的开始删除本服务的日志文件，正在写的文件不删
+-- @param max_files number 最多保留文件数，0不限
+-- @param max_bytes number 最多保留总字节数，0不限
+-- @param max_age_sec number 最长保留秒数（按修改时间），0不限
+function alog.setretention(max_files, max_bytes, max_age_sec)
+    setretention(max_files or 0, max_bytes or 0, max_age_sec or 0)
+end
+
+-- 设置换出文件压缩：整点/按大小换出的文件由后台低优先级线程压缩为.log.gz（zcat/zgrep可直接读）并生成.idx索引
+-- @param level number gzip级别1~9，0不压缩，默认6
+-- @param cpu_percent number 压缩线程占用单核的上限（1~100），默认20
+function alog.setcompress(level, cpu_percent)
+    setcompress(level or 6, cpu_percent or 20)
+end
+
+-- 设置内存映射写（Linux）：之后打开的日志文件按块预分配并映射，日志直接拷贝进映射区，进程崩溃不丢已写日志
+-- @param chunk_bytes number 映射块大小，默认4MB，0恢复stdio写
+function alog.setmmap(chunk_bytes)
+    setmmap(chunk_bytes or 4 * 1024 * 1024)
+end
+
+-- 设置共享内存实时日志环（默认4MB），请在setroot前设置；用aalog-tail工具跟踪，比print_screen开销小得多
+-- @param bytes number 环大小，0不开启
+function alog.setlive(bytes)
+    setlive(bytes)
+end
+
+-- 设置崩溃转储（默认开启）：进程因致命信号结束前，把调用栈、各线程当前作业和未写出的日志写入日志目录下的crash_*.log
+-- @param v bool
+function alog.setcrashdump(v)
+    setcrashdump(v)
+end
+
+-- 日志队列状态
+-- @return {count=排队条数, bytes=排队字节, budget=预算, drop_info=, drop_debug=, drop_warning=（超预算累计丢弃数）}
+function alog.getqueue()
+    return getqueue()
+end
+
+-- 设置线程日志环（每个写日志线程一个无锁环，日志线程按时间归并写出）
+-- @param bytes number 新建环的容量（字节，取2的幂），默认256KB，0不修改
+-- @param policy string 环满时：block等待，drop丢弃并计数，spill转入加锁链表（默认）
+function alog.setring(bytes, policy)
+    local v = assert(ring_policies[policy or "spill"], "alog.setring：未知的策略 " .. tostring(policy))
+    setring(bytes or 0, v)
+end
+
+-- 各线程因环满丢弃的日志数
+-- @return table {["线程名:tid"] = 数量, exited = 已退出线程合计, total = 总数}
+function alog.getdrops()
+    return getdrops()
+end
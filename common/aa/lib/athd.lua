@@ -2,6 +2,7 @@ local mp   = require "cmsgpack"
 local id_count = 0
 local work_fns = {}
 local done_fns = {}
+local tick_fn = nil
 
 if not athd then
     athd = {}
@@ -39,6 +40,16 @@ local getct = athd.getct
 local getctid = athd.getctid
 local setjobcapecity = athd.setjobcapecity
 local setjobtimeoutlimit = athd.setjobtimeoutlimit
+local cancelpjobs = athd.cancelpjobs
+local getstatus = athd.getstatus
+local setedf = athd.setedf
+local getstats = athd.getstats
+local settick = athd.settick
+
+--- 作业状态（回执函数中athd.getstatus()的返回值）
+athd.STATUS_OK = 0
+athd.STATUS_CANCELLED = 1
+athd.STATUS_TIMEOUT = 2
 
 --- @brief 线程/线程池创建
 function athd.newthread(thd_name, entry_name, ms)
@@ -142,3 +153,52 @@ function athd.setjobtimeoutlimit(tp, v)
     ahar["setjobtimeoutlimit"] = setjobtimeoutlimit
     setjobtimeoutlimit(tp, v);
 end
+
+--- @brief 取消线程池中指定一致性ID已压入且尚未执行的全部作业
+--- 被取消的作业不执行作业函数，回执函数无参数调用，athd.getstatus()返回athd.STATUS_CANCELLED
+--- @param pool 线程池对象，new_pool返回值
+--- @param cid 一致性id/key（pushpjobby所用）
+function athd.cancelpjobs(pool, cid)
+    athd["cancelpjobs"] = cancelpjobs
+    cancelpjobs(pool, cid)
+end
+
+--- @brief 当前回执的作业状态，仅在回执函数中有效
+--- @return athd.STATUS_OK / athd.STATUS_CANCELLED / athd.STATUS_TIMEOUT
+function athd.getstatus()
+    athd["getstatus"] = getstatus
+    return getstatus()
+end
+
+--- @brief 截止时间优先（EDF），线程每批作业按截止时间排序执行
+--- @param t 线程对象，nil为当前线程
+--- @param v true开启/false关闭
+function athd.setedf(t, v)
+    athd["setedf"] = setedf
+    setedf(t, v)
+end
+
+--- @brief 线程作业统计
+--- @param t 线程对象，nil为当前线程
+--- @return {exec=已执行, cancel=已取消, shed=超时丢弃, pending=排队中,
+---          tick=帧数, overrun=超时帧数, skip=跳过帧数, maxframe=最大帧耗时(纳秒)}
+function athd.getstats(t)
+    athd["getstats"] = getstats
+    return getstats(t)
+end
+
+--- @brief 帧回调（定帧模式下由C++每帧调用）
+function athd.ontick()
+    if tick_fn then
+        tick_fn()
+    end
+end
+
+--- @brief 当前线程进入定帧模式，帧间继续处理作业
+--- @param ms 帧周期（毫秒），0恢复事件驱动
+--- @param budget 两次检查帧之间最多执行的作业数，0不限
+--- @param fn 帧函数
+function athd.settick(ms, budget, fn)
+    tick_fn = fn
+    settick(ms, budget or 0)
+end
@@ -16,6 +16,326 @@ namespace ahar
     }
     auto _ = get_mdata();
 
+    // 线程退出时归还槽位
+    struct slot_holder
+    {
+        reader_slot* slot_ = nullptr;
+        ~slot_holder()
+        {
+            if (slot_)
+            {
+                slot_->is_used_.store(false, std::memory_order_release);
+            }
+        }
+    };
+    thread_local slot_holder tls_slot_;
+
+    rcu::~rcu()
+    {
+        for (auto& r : retired_)
+        {
+            r.del_(r.p_);
+        }
+        auto s = slots_.load(std::memory_order_relaxed);
+        while (s)
+        {
+            auto next = s->next_;
+            delete s;
+            s = next;
+        }
+    }
+
+    reader_slot* rcu::acquire_slot()
+    {
+        for (auto s = slots_.load(std::memory_order_acquire); s; s = s->next_)
+        {
+            bool expected = false;
+            if (!s->is_used_.load(std::memory_order_relaxed)
+                && s->is_used_.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                return s;
+            }
+        }
+        auto s = new reader_slot;
+        s->is_used_.store(true, std::memory_order_relaxed);
+        auto head = slots_.load(std::memory_order_relaxed);
+        do
+        {
+            s->next_ = head;
+        } while (!slots_.compare_exchange_weak(head, s, std::memory_order_release, std::memory_order_relaxed));
+        return s;
+    }
+
+    reader_slot* rcu::enter()
+    {
+        auto s = tls_slot_.slot_;
+        if (!s)
+        {
+            s = tls_slot_.slot_ = acquire_slot();
+        }
+        // 与写端的“替换快照 -> 推进纪元 -> 检查槽位”都用seq_cst：写端看到槽位为0时，读端随后load必得新快照
+        if (s->depth_++ == 0)
+        {
+            s->epoch_.store(epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+        return s;
+    }
+
+    void rcu::leave(reader_slot* slot)
+    {
+        if (--slot->depth_ == 0)
+        {
+            slot->epoch_.store(0, std::memory_order_release);
+        }
+    }
+
+    void rcu::retire(void* p, void (*del)(void*))
+    {
+        auto epoch = epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+        retired_.push_back({epoch, p, del});
+        reclaim();
+    }
+
+    void rcu::reclaim()
+    {
+        // 仍在读的槽位中最早的进入纪元，早于它挂起的快照已无人引用
+        auto min_epoch = UINT64_MAX;
+        for (auto s = slots_.load(std::memory_order_acquire); s; s = s->next_)
+        {
+            auto e = s->epoch_.load(std::memory_order_seq_cst);
+            if (e && e < min_epoch)
+            {
+                min_epoch = e;
+            }
+        }
+        std::size_t kept = 0;
+        for (auto& r : retired_)
+        {
+            if (r.epoch_ <= min_epoch)
+            {
+                r.del_(r.p_);
+            }
+            else
+            {
+                retired_[kept++] = r;
+            }
+        }
+        retired_.resize(kept);
+    }
+
+    // 以下两函数须持有mtx_
+    void publish_route(mdata* md, const minfo* mi)
+    {
+        auto curr = md->routes_.load();
+        auto next = curr ? std::make_unique<route_map>(*curr) : std::make_unique<route_map>();
+        auto& route = (*next)[mi->mid_];
+        route.info_ = mi;
+        route.balance_ = mi->balance_;
+        route.handlers_.clear();
+        route.cands_.clear();
+        for (auto& h : mi->mhandlers_)
+        {
+            if (h->htype_ != 1)
+            {
+                route.cands_.push_back((std::uint32_t)route.handlers_.size());
+            }
+            route.handlers_.push_back(*h);
+        }
+        md->routes_.publish(md->rcu_, std::move(next));
+    }
+
+    void publish_owner(mdata* md, std::uint64_t oid, athd::thread* t)
+    {
+        auto& shard = md->owners_[owner_shard(oid)];
+        auto curr = shard.load();
+        if (!t && (!curr || !curr->count(oid)))
+        {
+            return;
+        }
+        auto next = curr ? std::make_unique<owner_map>(*curr) : std::make_unique<owner_map>();
+        if (t)
+        {
+            (*next)[oid] = t;
+        }
+        else
+        {
+            next->erase(oid);
+        }
+        shard.publish(md->rcu_, std::move(next));
+    }
+
+    // ctx非空为call请求：处理线程先登记应答路由，再以cid调用处理函数
+    void push_to(const mhandler& hinfo, const minfo* mi, std::uint64_t mid, const athd::abuf& buf, const call_ctx* ctx)
+    {
+        auto htype = hinfo.htype_;
+        auto hand = hinfo.hand_;
+        auto call = ctx ? *ctx : call_ctx{};
+        hinfo.thread_->pushjob(
+            mi->mname_.c_str(),
+            [=]() -> void*
+            {
+                if (call.cid_)
+                {
+                    add_reply_route(call);
+                }
+                if (htype == 2)
+                {
+                    (reinterpret_cast<ahar_hand_buf>(hand))(call.cid_, mid, mi->mname_, buf);
+                }
+                else
+                {
+                    (reinterpret_cast<ahar_hand>(hand))(call.cid_, mid, mi->mname_, buf);
+                }
+                return nullptr;
+            },
+            nullptr
+        );
+    }
+
+    // 一致性哈希（Jump Consistent Hash）：监听者增减时只有约1/n的key换线程
+    int jump_hash(std::uint64_t key, int buckets)
+    {
+        std::int64_t b = -1;
+        std::int64_t j = 0;
+        while (j < buckets)
+        {
+            b = j;
+            key = key * 2862933555777941757ULL + 1;
+            j = (std::int64_t)((b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+        }
+        return (int)b;
+    }
+
+    // 在发送线程上直接查快照并压入各处理线程，消息体至多复制一次（ref非空时不复制），各接收线程共享引用
+    //    dest_thd非空时只投递给该线程上的第一个处理者；call请求（ctx非空）只投递一个，rid不存在时不投递
+    //    返回是否已投递
+    bool dispatch(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, const athd::abuf* ref, const call_ctx* ctx)
+    {
+        auto md = get_mdata();
+        read_guard guard(md->rcu_);
+        auto routes = md->routes_.load();
+        if (!routes)
+        {
+            return false;
+        }
+        auto it = routes->find((std::uint32_t)mid);
+        if (it == routes->end())
+        {
+            return false;
+        }
+
+        athd::thread* dest_thd = nullptr;
+        if (rid)
+        {
+            auto owners = md->owners_[owner_shard(rid)].load();
+            if (owners)
+            {
+                auto oit = owners->find(rid);
+                if (oit != owners->end())
+                {
+                    dest_thd = oit->second;
+                }
+            }
+            if (!dest_thd && ctx)
+            {
+                return false;
+            }
+        }
+
+        auto mi = it->second.info_;
+        athd::abuf buf;
+        bool is_copied = false;
+        bool is_sent = false;
+        if (ref)
+        {
+            buf = *ref;
+            is_copied = true;
+        }
+        for (auto& hinfo : it->second.handlers_)
+        {
+            if (dest_thd && dest_thd != hinfo.thread_)
+            {
+                continue;
+            }
+
+            if (hinfo.htype_ == 1)
+            {
+                //(reinterpret_cast<ahar_hand_pb>(hinfo.hand_))(0, nullptr);
+            }
+            else
+            {
+                if (!is_copied)
+                {
+                    buf = athd::abuf(mb);
+                    is_copied = true;
+                }
+                push_to(hinfo, mi, mid, buf, ctx);
+                is_sent = true;
+            }
+
+            if (dest_thd || (ctx && is_sent))
+            {
+                return is_sent;
+            }
+        }
+        return is_sent;
+    }
+
+    // 按消息的均衡方式选一个处理者投递，与dispatch同样只读快照，返回是否已投递
+    bool balance(std::uint64_t key, bool has_key, std::uint64_t mid, const atype::abuf& mb, const athd::abuf* ref, const call_ctx* ctx)
+    {
+        auto md = get_mdata();
+        read_guard guard(md->rcu_);
+        auto routes = md->routes_.load();
+        if (!routes)
+        {
+            return false;
+        }
+        auto it = routes->find((std::uint32_t)mid);
+        if (it == routes->end())
+        {
+            return false;
+        }
+
+        auto& route = it->second;
+        auto& cands = route.cands_;
+        auto count = (int)cands.size();
+        if (!count)
+        {
+            return false;
+        }
+
+        auto mi = route.info_;
+        const mhandler* target;
+        if (route.balance_ == BALANCE_STICKY && has_key)
+        {
+            target = &route.handlers_[cands[jump_hash(key, count)]];
+        }
+        else
+        {
+            auto start = mi->rr_.fetch_add(1, std::memory_order_relaxed) % count;
+            target = &route.handlers_[cands[start]];
+            if (route.balance_ == BALANCE_LEAST_PENDING)
+            {
+                // 从轮询位置开始比较，排队数相同时仍轮流分摊
+                auto least = athd::getpending(target->thread_);
+                for (int i = 1; i < count && least; ++i)
+                {
+                    auto h = &route.handlers_[cands[(start + i) % count]];
+                    auto pending = athd::getpending(h->thread_);
+                    if (pending < least)
+                    {
+                        least = pending;
+                        target = h;
+                    }
+                }
+            }
+        }
+
+        push_to(*target, mi, mid, ref ? *ref : athd::abuf(mb), ctx);
+        return true;
+    }
+
     void listen(atype::astr name, void* handler, void* data, athd::thread* t, int htype)
     {
         auto md = get_mdata();
@@ -46,9 +366,8 @@ namespace ahar
         mhand->data_ = data;
         mhand->hand_ = handler;
         mhand->thread_ = t;
+        publish_route(md, minfo);
     }
-
-    static auto har_thd_ = athd::newthread("tharbor");
 }
 
 AA_API std::uint64_t ahar_regmsg(atype::astr name, int type)
@@ -98,6 +417,7 @@ AA_API std::uint64_t ahar_regmsg(atype::astr name, int type)
 
     minfo_by_id[id] = minfo;
     minfo_by_name[name] = minfo;
+    ahar::publish_route(md, minfo);
 
     return id;
 }
@@ -107,6 +427,11 @@ AA_API void ahar_listen(atype::astr name, ahar_hand handler, void* data, athd::t
     ahar::listen(name, *(void**)&handler, data, t, 0);
 }
 
+AA_API void ahar_listenbuf(atype::astr name, ahar_hand_buf handler, void* data, athd::thread* t)
+{
+    ahar::listen(name, *(void**)&handler, data, t, 2);
+}
+
 AA_API void ahar_enterct(std::uint64_t oid, ref_lobj lo)
 {
     auto md = ahar::get_mdata();
@@ -117,6 +442,7 @@ AA_API void ahar_enterct(std::uint64_t oid, ref_lobj lo)
     oinfo->idx_ = lo.idx_;
     oinfo->obj_ = lo.obj_;
     md->oinfo_by_id_[oid] = std::unique_ptr<ahar::oinfo>(oinfo);
+    ahar::publish_owner(md, oid, oinfo->thread_);
 }
 
 AA_API void ahar_leavect(std::uint64_t oid)
@@ -124,154 +450,70 @@ AA_API void ahar_leavect(std::uint64_t oid)
     auto md = ahar::get_mdata();
     std::lock_guard<std::recursive_mutex> lock(md->mtx_);
     md->oinfo_by_id_.erase(oid);
+    ahar::publish_owner(md, oid, nullptr);
 }
 
-AA_API void ahar_send(std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_setbalance(atype::astr name, int mode)
 {
-
+    auto md = ahar::get_mdata();
+    std::lock_guard<std::recursive_mutex> lock(md->mtx_);
+    auto it = md->minfo_by_id_.find(aid::crc32(name.data(), name.size()));
+    if (it == md->minfo_by_id_.end())
+    {
+        auto id = ahar_regmsg(name, 0);
+        it = md->minfo_by_id_.find(id);
+        if (it == md->minfo_by_id_.end())
+        {
+            return;
+        }
+    }
+    if (mode < BALANCE_ROUND_ROBIN || mode > BALANCE_STICKY)
+    {
+        alua::error("ahar_setbalance：消息“{}”的均衡方式{}无效", name, mode);
+        return;
+    }
+    it->second->balance_ = mode;
+    ahar::publish_route(md, it->second);
 }
 
-AA_API void ahar_send_cross(std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_send(std::uint64_t mid, const atype::abuf& mb)
 {
-
+    ahar::balance(0, false, mid, mb, nullptr, nullptr);
 }
 
-AA_API void ahar_sendto(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_sendby(std::uint64_t key, std::uint64_t mid, const atype::abuf& mb)
 {
-    auto do_send = [=]()
-        {
-            auto md = ahar::get_mdata();
-            std::lock_guard<std::recursive_mutex> lock(md->mtx_);
-            auto& minfo_by_id = md->minfo_by_id_;
-
-            athd::thread* dest_thd = nullptr;
-            if (rid)
-            {
-                auto& oinfo_by_id_ = md->oinfo_by_id_;
-                auto it = oinfo_by_id_.find(rid);
-                if (it != oinfo_by_id_.end())
-                {
-                    dest_thd = it->second->thread_;
-                }
-            }
-            
-            auto it = minfo_by_id.find(mid);
-            if (it == minfo_by_id.end())
-            {
-                return;
-            }
-
-            auto mi = it->second;
-            for (auto& hinfo : mi->mhandlers_)
-            {
-                if (dest_thd && dest_thd != hinfo->thread_)
-                {
-                    continue;
-                }
-
-                if (hinfo->htype_ == 1)
-                {
-                    //(reinterpret_cast<ahar_hand_pb>(hinfo->hand_))(0, nullptr);
-                }
-                else
-                {
-                    auto t = hinfo->thread_;
-                    t->pushjob(
-                        mi->mname_.c_str(),
-                        [=, hi=hinfo.get(),mb=std::string(mb)]() -> void*
-                        {
-                            (reinterpret_cast<ahar_hand>(hi->hand_))(0, mid, mi->mname_, mb);
-                            return nullptr;
-                        },
-                        nullptr
-                    );
-                }
-
-                if (dest_thd)
-                {
-                    return;
-                }
-            }
-        };
-
-    ahar::har_thd_->pushjob("ahar_send_buf_to", do_send);
+    ahar::balance(key, true, mid, mb, nullptr, nullptr);
 }
 
-AA_API void ahar_sendto_cross(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_send_cross(std::uint64_t mid, const atype::abuf& mb)
 {
 
 }
 
-AA_API void ahar_call(std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_sendto(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb)
 {
-
+    ahar::dispatch(rid, mid, mb, nullptr, nullptr);
 }
 
-AA_API void ahar_call_cross(std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_sendtobuf(std::uint64_t rid, std::uint64_t mid, const athd::abuf& mb)
 {
-
+    ahar::dispatch(rid, mid, mb, &mb, nullptr);
 }
 
-AA_API void ahar_callto(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_sendto_cross(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb)
 {
 
 }
 
-AA_API void ahar_callto_cross(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_svcbc(std::uint64_t mid, const atype::abuf& mb)
 {
-    
+    ahar::dispatch(0, mid, mb, nullptr, nullptr);
 }
 
-AA_API void ahar_svcbc(std::uint64_t mid, const atype::abuf& mb)
+AA_API void ahar_svcbcbuf(std::uint64_t mid, const athd::abuf& mb)
 {
-    auto do_send = [=]()
-        {
-            auto md = ahar::get_mdata();
-            std::lock_guard<std::recursive_mutex> lock(md->mtx_);
-            auto& minfo_by_id = md->minfo_by_id_;
-
-            athd::thread* dest_thd = nullptr;
-            
-            auto it = minfo_by_id.find(mid);
-            if (it == minfo_by_id.end())
-            {
-                return;
-            }
-
-            auto mi = it->second;
-            for (auto& hinfo : mi->mhandlers_)
-            {
-                if (dest_thd && dest_thd != hinfo->thread_)
-                {
-                    continue;
-                }
-
-                if (hinfo->htype_ == 1)
-                {
-                    //(reinterpret_cast<ahar_hand_pb>(hinfo->hand_))(0, nullptr);
-                }
-                else
-                {
-                    auto t = hinfo->thread_;
-                    t->pushjob(
-                        mi->mname_.c_str(),
-                        [=, hi=hinfo.get(),mb=std::string(mb)]() -> void*
-                        {
-                            (reinterpret_cast<ahar_hand>(hi->hand_))(0, mid, mi->mname_, mb);
-                            return nullptr;
-                        },
-                        nullptr
-                    );
-                }
-
-                if (dest_thd)
-                {
-                    return;
-                }
-            }
-        };
-
-    ahar::har_thd_->pushjob("ahar_svc_broadcast_buf", do_send);
+    ahar::dispatch(0, mid, mb, &mb, nullptr);
 }
 
 AA_API void ahar_svcbc_cross(std::uint64_t mid, const atype::abuf& mb)
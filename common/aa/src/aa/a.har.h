@@ -1,5 +1,10 @@
+#include <array>
+#include <atomic>
+#include <map>
 #include <mutex>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "athd.h"
 #include "ahar.h"
@@ -9,7 +14,7 @@ namespace ahar
     struct mhandler
     {
     public:
-        int htype_;
+        int htype_;             // 0：ahar_hand，1：protobuf，2：ahar_hand_buf
         athd::thread* thread_;
         void* data_;
         void* hand_;
@@ -21,8 +26,10 @@ namespace ahar
         int mtype_ = 0; // 消息类型：0：msgpack，1：protobuf
         int stype_ = 0; // 发送类型：0：线程间，1：服务间，2：客户端
         std::uint32_t mid_ = 0;
+        int balance_ = BALANCE_ROUND_ROBIN; // ahar_send的均衡方式，见BalanceMode
         std::string mname_;
         std::vector<std::unique_ptr<mhandler>> mhandlers_;
+        mutable std::atomic_uint32_t rr_{0}; // 轮询计数，发送方不加锁递增
         bool is_tmsg()
         {
             return stype_ == 0;
@@ -46,13 +53,160 @@ namespace ahar
         void* obj_;
     };
 
+    // 路由快照中的消息：发布后只读，info_指向minfos_中的消息（不释放）
+    struct mroute
+    {
+        const minfo* info_ = nullptr;
+        int balance_ = BALANCE_ROUND_ROBIN;
+        std::vector<mhandler> handlers_;
+        std::vector<std::uint32_t> cands_;  // 可均衡投递的处理者在handlers_中的下标（protobuf处理者暂不支持）
+    };
+
+    using route_map = std::unordered_map<std::uint32_t, mroute>;       // 消息ID -> 处理者
+    using owner_map = std::unordered_map<std::uint64_t, athd::thread*>; // 对象ID -> 所在线程
+
+    // 对象所在线程按ID哈希分片发布：对象进出线程只复制所在分片，不复制全部对象
+    constexpr std::size_t owner_shards = 1024;
+
+    inline std::size_t owner_shard(std::uint64_t oid)
+    {
+        return (std::size_t)((oid * 0x9E3779B97F4A7C15ull) >> 54);
+    }
+
+    // 读端槽位：每个读线程占用一个，读期间记录进入时的纪元，0表示不在读
+    struct reader_slot
+    {
+        std::atomic_uint64_t epoch_{0};
+        std::atomic_bool is_used_{false};
+        int depth_ = 0;                 // 嵌套读的层数，只由占用线程访问
+        reader_slot* next_ = nullptr;
+    };
+
+    // 基于纪元的RCU：读端只写自己的槽位，不加锁；写端（持有mdata::mtx_）替换快照后把旧快照挂起，
+    //    所有槽位都不在读或进入纪元不早于挂起纪元时释放
+    class rcu
+    {
+    public:
+        ~rcu();
+        reader_slot* enter();
+        void leave(reader_slot* slot);
+        void retire(void* p, void (*del)(void*));
+        void reclaim();
+
+    private:
+        struct retired
+        {
+            std::uint64_t epoch_;
+            void* p_;
+            void (*del_)(void*);
+        };
+        reader_slot* acquire_slot();
+
+        std::atomic_uint64_t epoch_{1};
+        std::atomic<reader_slot*> slots_{nullptr};   // 只增不减，线程退出后槽位复用
+        std::vector<retired> retired_;
+    };
+
+    class read_guard
+    {
+    public:
+        explicit read_guard(rcu& r) : rcu_(r), slot_(r.enter())
+        {
+        }
+        ~read_guard()
+        {
+            rcu_.leave(slot_);
+        }
+        read_guard(const read_guard&) = delete;
+        read_guard& operator=(const read_guard&) = delete;
+
+    private:
+        rcu& rcu_;
+        reader_slot* slot_;
+    };
+
+    // 不可变快照指针：读端在read_guard内load，写端publish新快照
+    template <typename T>
+    class snapshot
+    {
+    public:
+        ~snapshot()
+        {
+            delete ptr_.load(std::memory_order_relaxed);
+        }
+
+        const T* load() const
+        {
+            return ptr_.load(std::memory_order_seq_cst);
+        }
+
+        void publish(rcu& r, std::unique_ptr<T> next)
+        {
+            auto old = ptr_.exchange(next.release(), std::memory_order_seq_cst);
+            if (old)
+            {
+                r.retire(old, [](void* p) { delete static_cast<T*>(p); });
+            }
+        }
+
+    private:
+        std::atomic<T*> ptr_{nullptr};
+    };
+
+    // call请求随消息投递的上下文：应答按caller_路由回调用方线程
+    struct call_ctx
+    {
+        std::uint64_t cid_ = 0;             // 关联ID（aid_gen）
+        athd::thread* caller_ = nullptr;
+        std::uint64_t deadline_ = 0;        // 超时时间（atime::msec()）
+    };
+
+    // 调用超时的定时器：共享一个定帧线程（athd_settick），按时间登记各调用方线程的唤醒，
+    //    到期时向该线程压入一个清理作业，由它一次清理本线程全部过期调用；没有登记时停帧
+    class rpc_timer
+    {
+    public:
+        static constexpr std::uint64_t tick_ms = 10;    // 定时精度，同一帧内到期的合并清理
+
+        void wake(athd::thread* t, std::uint64_t at);
+
+    private:
+        static void on_tick(void* data);
+
+        std::mutex mtx_;
+        std::multimap<std::uint64_t, athd::thread*> wakes_;   // 唤醒时间 -> 调用方线程
+        bool is_ticking_ = false;
+    };
+
     class mdata
     {
     public:
+        // 写端：注册、监听、对象进出线程时持锁修改下列表并发布快照；发送方只读快照
         std::recursive_mutex mtx_;
         std::vector<std::unique_ptr<minfo>> minfos_;
         std::unordered_map<std::uint32_t, minfo*> minfo_by_id_;
         std::unordered_map<std::string_view, minfo*> minfo_by_name_;
         std::unordered_map<std::uint64_t, std::unique_ptr<oinfo>> oinfo_by_id_;
+
+        rcu rcu_;
+        snapshot<route_map> routes_;
+        std::array<snapshot<owner_map>, owner_shards> owners_;
+        rpc_timer timer_;
+    };
+
+    mdata* get_mdata();
+    bool dispatch(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, const athd::abuf* ref, const call_ctx* ctx);
+    bool balance(std::uint64_t key, bool has_key, std::uint64_t mid, const atype::abuf& mb, const athd::abuf* ref, const call_ctx* ctx);
+
+    // RPC（a.har.rpc.cpp）
+    void add_reply_route(const call_ctx& ctx);
+    enum CallRoute
+    {
+        CALL_BALANCE = 0,   // 按ahar_setbalance选一个处理者
+        CALL_TO,            // 投给rid所在线程
+        CALL_CROSS          // 跨进程（传输尚未实现，按RPC_NOROUTE应答）
     };
-}
\ No newline at end of file
+    std::uint64_t call(int route, std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, const athd::abuf* ref,
+        ahar_resp cb, void* data, std::uint32_t timeout_ms);
+    bool reply(std::uint64_t cid, const athd::abuf& mb);
+}
@@ -9,14 +9,57 @@ namespace
 {
     auto mod_name = "ahar";
 
-    inline void on_buf(std::uint64_t cid, std::uint64_t mid, const atype::astr& name, const atype::abuf& mb)
+    // 消息体以athd.abuf传给Lua，各接收线程共享同一份，不复制
+    inline void on_buf(std::uint64_t cid, std::uint64_t mid, const atype::astr&, const athd::abuf& mb)
     {
         alua::call(mod_name, "on_buf", mid, mb, cid);
     }
 
     inline void do_listen(atype::astr name)
     {
-        ahar_listen(name, on_buf);
+        ahar_listenbuf(name, on_buf);
+    }
+
+    // Lua传入的athd.abuf直接共享，字符串复制一次
+    inline void do_send(std::uint64_t mid, const athd::abuf& mb)
+    {
+        ahar::balance(0, false, mid, mb, &mb, nullptr);
+    }
+
+    inline void do_sendby(std::uint64_t key, std::uint64_t mid, const athd::abuf& mb)
+    {
+        ahar::balance(key, true, mid, mb, &mb, nullptr);
+    }
+
+    // call应答在发起线程执行，转给ahar.on_resp按cid找Lua回调
+    inline void on_resp(std::uint64_t cid, int status, const athd::abuf& mb, void*)
+    {
+        alua::call(mod_name, "on_resp", cid, status, mb);
+    }
+
+    inline std::uint64_t do_call(std::uint64_t mid, const athd::abuf& mb, std::uint32_t timeout_ms)
+    {
+        return ahar::call(ahar::CALL_BALANCE, 0, mid, mb, &mb, on_resp, nullptr, timeout_ms);
+    }
+
+    inline std::uint64_t do_call_cross(std::uint64_t mid, const athd::abuf& mb, std::uint32_t timeout_ms)
+    {
+        return ahar::call(ahar::CALL_CROSS, 0, mid, mb, &mb, on_resp, nullptr, timeout_ms);
+    }
+
+    inline std::uint64_t do_callto(std::uint64_t rid, std::uint64_t mid, const athd::abuf& mb, std::uint32_t timeout_ms)
+    {
+        return ahar::call(ahar::CALL_TO, rid, mid, mb, &mb, on_resp, nullptr, timeout_ms);
+    }
+
+    inline std::uint64_t do_callto_cross(std::uint64_t rid, std::uint64_t mid, const athd::abuf& mb, std::uint32_t timeout_ms)
+    {
+        return ahar::call(ahar::CALL_CROSS, rid, mid, mb, &mb, on_resp, nullptr, timeout_ms);
+    }
+
+    inline bool do_reply(std::uint64_t cid, const athd::abuf& mb)
+    {
+        return ahar::reply(cid, mb);
     }
 
     inline void do_regmsg(atype::astr name, int mtype)
@@ -32,15 +75,18 @@ namespace
                 {"listen", alua::tocfunc<do_listen>()},
                 {"enterct", alua::tocfunc<ahar_enterct>()},
                 {"leavect", alua::tocfunc<ahar_leavect>()},
-                {"send", alua::tocfunc<ahar_send>()},
+                {"setbalance", alua::tocfunc<ahar_setbalance>()},
+                {"send", alua::tocfunc<do_send>()},
+                {"sendby", alua::tocfunc<do_sendby>()},
                 {"send_cross", alua::tocfunc<ahar_send_cross>()},
-                {"sendto", alua::tocfunc<ahar_sendto>()},
+                {"sendto", alua::tocfunc<ahar_sendtobuf>()},
                 {"sendto_cross", alua::tocfunc<ahar_sendto_cross>()},
-                {"call", alua::tocfunc<ahar_call>()},
-                {"call_cross", alua::tocfunc<ahar_call_cross>()},
-                {"callto", alua::tocfunc<ahar_callto>()},
-                {"callto_cross", alua::tocfunc<ahar_callto_cross>()},
-                {"svcbc", alua::tocfunc<ahar_svcbc>()},
+                {"call", alua::tocfunc<do_call>()},
+                {"call_cross", alua::tocfunc<do_call_cross>()},
+                {"callto", alua::tocfunc<do_callto>()},
+                {"callto_cross", alua::tocfunc<do_callto_cross>()},
+                {"reply", alua::tocfunc<do_reply>()},
+                {"svcbc", alua::tocfunc<ahar_svcbcbuf>()},
                 {"svcbc_cross", alua::tocfunc<ahar_svcbc_cross>()},
                 {"gatebc", alua::tocfunc<ahar_gatebc>()},
                 {"groupadd", alua::tocfunc<ahar_groupadd>()},
@@ -0,0 +1,255 @@
+#include "ahcpp.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "aid.h"
+#include "alua.h"
+#include "atime.h"
+
+#include "a.har.h"
+
+// 请求/应答：调用方的待应答表和处理方的应答路由表都是thread_local，只由所属线程访问，不加锁；
+//    跨线程只通过压作业：请求投给处理线程，应答和超时清理投回调用方线程
+
+namespace ahar
+{
+    namespace
+    {
+        constexpr std::uint32_t default_timeout_ms = 30000;
+        constexpr std::uint64_t route_sweep_ms = 1000;      // 处理方清理过期应答路由的间隔
+
+        struct pending_call
+        {
+            ahar_resp cb_;
+            void* data_;
+            std::uint64_t deadline_;
+        };
+
+        using deadline_item = std::pair<std::uint64_t, std::uint64_t>;  // 超时时间, cid
+
+        // 调用方：待应答表 + 按超时时间的小顶堆（已完成的cid留在堆中，到期时跳过）
+        struct call_table
+        {
+            std::unordered_map<std::uint64_t, pending_call> calls_;
+            std::priority_queue<deadline_item, std::vector<deadline_item>, std::greater<deadline_item>> deadlines_;
+            std::uint64_t wake_at_ = 0;     // 已向定时器登记的最早唤醒时间，0：未登记
+        };
+
+        // 处理方：已收到、尚未应答的请求的回程
+        struct reply_table
+        {
+            std::unordered_map<std::uint64_t, call_ctx> routes_;
+            std::uint64_t next_sweep_ = 0;
+        };
+
+        thread_local call_table tls_calls_;
+        thread_local reply_table tls_replies_;
+
+        // 定时器线程在模块初始化时创建（运行中不再新建athd线程），没有待超时的调用时停帧空闲
+        auto timer_thd_ = athd::newthread("tharbor.timer");
+
+        void schedule(call_table& tbl, athd::thread* self, std::uint64_t deadline)
+        {
+            auto at = (deadline + rpc_timer::tick_ms - 1) / rpc_timer::tick_ms * rpc_timer::tick_ms;
+            if (!tbl.wake_at_ || at < tbl.wake_at_)
+            {
+                tbl.wake_at_ = at;
+                get_mdata()->timer_.wake(self, at);
+            }
+        }
+
+        // 堆中已完成的项远多于未完成时重建，避免高频短调用堆积
+        void compact(call_table& tbl)
+        {
+            if (tbl.deadlines_.size() < 1024 || tbl.deadlines_.size() < tbl.calls_.size() * 2)
+            {
+                return;
+            }
+            std::vector<deadline_item> items;
+            items.reserve(tbl.calls_.size());
+            for (auto& [cid, pc] : tbl.calls_)
+            {
+                items.emplace_back(pc.deadline_, cid);
+            }
+            tbl.deadlines_ = decltype(tbl.deadlines_)(std::greater<deadline_item>(), std::move(items));
+        }
+
+        // 在调用方线程执行：完成一个调用，已完成（如已超时）的忽略
+        void complete(std::uint64_t cid, int status, const athd::abuf& mb)
+        {
+            auto& tbl = tls_calls_;
+            auto it = tbl.calls_.find(cid);
+            if (it == tbl.calls_.end())
+            {
+                return;
+            }
+            auto pc = it->second;
+            tbl.calls_.erase(it);
+            pc.cb_(cid, status, mb, pc.data_);
+        }
+
+        // 在调用方线程执行：一次清理本线程全部过期调用，回调在清理完成后逐个执行（回调中可再发起调用）
+        void sweep()
+        {
+            auto& tbl = tls_calls_;
+            tbl.wake_at_ = 0;
+            auto now = atime::msec();
+            std::vector<std::pair<std::uint64_t, pending_call>> expired;
+            while (!tbl.deadlines_.empty() && tbl.deadlines_.top().first <= now)
+            {
+                auto cid = tbl.deadlines_.top().second;
+                tbl.deadlines_.pop();
+                auto it = tbl.calls_.find(cid);
+                if (it != tbl.calls_.end() && it->second.deadline_ <= now)
+                {
+                    expired.emplace_back(cid, it->second);
+                    tbl.calls_.erase(it);
+                }
+            }
+            if (!tbl.calls_.empty() && !tbl.deadlines_.empty())
+            {
+                schedule(tbl, athd::getct(), tbl.deadlines_.top().first);
+            }
+
+            athd::abuf empty;
+            for (auto& [cid, pc] : expired)
+            {
+                pc.cb_(cid, RPC_TIMEOUT, empty, pc.data_);
+            }
+        }
+    }
+
+    void rpc_timer::wake(athd::thread* t, std::uint64_t at)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        wakes_.emplace(at, t);
+        if (!is_ticking_)
+        {
+            athd_settick(timer_thd_, tick_ms, 0, on_tick, this);
+            is_ticking_ = true;
+        }
+    }
+
+    void rpc_timer::on_tick(void* data)
+    {
+        auto self = static_cast<rpc_timer*>(data);
+        auto now = atime::msec();
+        std::vector<athd::thread*> due;
+        {
+            std::lock_guard<std::mutex> lock(self->mtx_);
+            auto end = self->wakes_.upper_bound(now);
+            for (auto it = self->wakes_.begin(); it != end; ++it)
+            {
+                if (std::find(due.begin(), due.end(), it->second) == due.end())
+                {
+                    due.push_back(it->second);
+                }
+            }
+            self->wakes_.erase(self->wakes_.begin(), end);
+            if (self->wakes_.empty())
+            {
+                athd_settick(timer_thd_, 0, 0, nullptr, nullptr);
+                self->is_ticking_ = false;
+            }
+        }
+        for (auto t : due)
+        {
+            t->pushjob("ahar.rpc.sweep", []() -> void* { sweep(); return nullptr; });
+        }
+    }
+
+    void add_reply_route(const call_ctx& ctx)
+    {
+        auto& tbl = tls_replies_;
+        auto now = atime::msec();
+        if (now >= tbl.next_sweep_)
+        {
+            // 超时未应答的回程批量丢弃（调用方已按超时回调）
+            std::erase_if(tbl.routes_, [now](const auto& kv) { return kv.second.deadline_ <= now; });
+            tbl.next_sweep_ = now + route_sweep_ms;
+        }
+        tbl.routes_[ctx.cid_] = ctx;
+    }
+
+    std::uint64_t call(int route, std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, const athd::abuf* ref,
+        ahar_resp cb, void* data, std::uint32_t timeout_ms)
+    {
+        auto self = athd::getct();
+        if (!self || !cb)
+        {
+            alua::error("ahar_call：须在athd线程中调用，应答函数不能为空");
+            return 0;
+        }
+
+        call_ctx ctx;
+        ctx.cid_ = aid_gen();
+        ctx.caller_ = self;
+        ctx.deadline_ = atime::msec() + (timeout_ms ? timeout_ms : default_timeout_ms);
+
+        auto& tbl = tls_calls_;
+        tbl.calls_[ctx.cid_] = {cb, data, ctx.deadline_};
+        tbl.deadlines_.emplace(ctx.deadline_, ctx.cid_);
+        compact(tbl);
+        schedule(tbl, self, ctx.deadline_);
+
+        bool is_sent = false;
+        if (route == CALL_BALANCE)
+        {
+            is_sent = balance(0, false, mid, mb, ref, &ctx);
+        }
+        else if (route == CALL_TO)
+        {
+            is_sent = dispatch(rid, mid, mb, ref, &ctx);
+        }
+        if (!is_sent)
+        {
+            // 同样异步回调，调用方不必区分完成方式
+            auto cid = ctx.cid_;
+            self->pushjob("ahar.rpc.noroute", [cid]() -> void* { complete(cid, RPC_NOROUTE, athd::abuf()); return nullptr; });
+        }
+        return ctx.cid_;
+    }
+
+    bool reply(std::uint64_t cid, const athd::abuf& mb)
+    {
+        auto& tbl = tls_replies_;
+        auto it = tbl.routes_.find(cid);
+        if (it == tbl.routes_.end())
+        {
+            return false;
+        }
+        auto caller = it->second.caller_;
+        tbl.routes_.erase(it);
+        caller->pushjob("ahar.rpc.reply", [cid, mb]() -> void* { complete(cid, RPC_OK, mb); return nullptr; });
+        return true;
+    }
+}
+
+AA_API std::uint64_t ahar_call(std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data, std::uint32_t timeout_ms)
+{
+    return ahar::call(ahar::CALL_BALANCE, 0, mid, mb, nullptr, cb, data, timeout_ms);
+}
+
+AA_API std::uint64_t ahar_call_cross(std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data, std::uint32_t timeout_ms)
+{
+    return ahar::call(ahar::CALL_CROSS, 0, mid, mb, nullptr, cb, data, timeout_ms);
+}
+
+AA_API std::uint64_t ahar_callto(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data, std::uint32_t timeout_ms)
+{
+    return ahar::call(ahar::CALL_TO, rid, mid, mb, nullptr, cb, data, timeout_ms);
+}
+
+AA_API std::uint64_t ahar_callto_cross(std::uint64_t rid, std::uint64_t mid, const atype::abuf& mb, ahar_resp cb, void* data, std::uint32_t timeout_ms)
+{
+    return ahar::call(ahar::CALL_CROSS, rid, mid, mb, nullptr, cb, data, timeout_ms);
+}
+
+AA_API bool ahar_reply(std::uint64_t cid, const atype::abuf& mb)
+{
+    return ahar::reply(cid, athd::abuf(mb));
+}
@@ -1,9 +1,20 @@
 #include "ahcpp.h"
 
 #include <string>
+#include <algorithm>
 #include <vector>
-#include <format>
+#include <charconv>
+#include <cerrno>
 #include <iostream>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <execinfo.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "atime.h"
 #include "afile.h"
@@ -11,6 +22,7 @@
 
 #include "athd.h"
 #include "a.log.h"
+#include "a.signal.h"
 
 namespace alog
 {
@@ -29,37 +41,18 @@ namespace alog
 
     log_file::~log_file()
     {
-        if(fp_)
+        for (auto& sink : sinks_)
         {
-            std::fclose(fp_);
-            fp_ = nullptr;
+            sink.close();
         }
     }
 
+    // 单文件批缓冲上限，超过提前写入
+    static constexpr std::size_t wbuf_limit = 4 * 1024 * 1024;
+
     static std::string level_names[4] = {"info", "debug", "warning", "error"};
     static std::string level_names_upper[4] = {"INF", "DBG", "WAR", "ERR"};
 
-    void log_file::rotate_file(struct tm* tm_info, int level, const std::string logdir, const std::string& process_flag_file_name)
-    {
-        if(fp_)
-        {
-            std::fclose(fp_);
-        }
-        hour_ = tm_info->tm_hour;
-
-        char time_str[64];
-        strftime(time_str, sizeof(time_str), "%Y-%m-%d-%H", tm_info);
-
-        full_filename_ = logdir + "/" + std::string(time_str) + "_" + process_flag_file_name + "_" + file_name_
-        + "_" + level_names[level] + ".log";
-
-        fp_ = std::fopen(full_filename_.c_str(), "ab");
-        if (!fp_)
-        {
-            std::cout << "日志文件打开失败：" << full_filename_ << std::endl;
-        }
-    }
-
     inline struct tm* safe_localtime(const time_t* t, struct tm* buf)
     {
     #ifdef _WIN32
@@ -74,189 +67,1272 @@ namespace alog
         return localtime_r(t, buf);
     #endif
     }
+
+    void log_file::rotate_file(log_sink& sink, time_t time_sec, int hour, int part, const char* level_name, const std::string logdir, const std::string& process_flag_file_name)
+    {
+        auto md = get_mdata();
+        std::string closed_file;
+        if (sink.fp_)
+        {
+            // 本批已缓冲的内容属于旧文件
+            sink.flush();
+            if (md->sync_mode_ != SYNC_NONE && sink.unsynced_bytes_)
+            {
+                sink.sync(atime::msec());
+            }
+            sink.close();
+            closed_file = std::move(sink.full_filename_);
+        }
+        sink.hour_ = hour;
+        sink.traced_.clear();
+
+        struct tm tm_info;
+        safe_localtime(&time_sec, &tm_info);
+        char time_str[64];
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d-%H", &tm_info);
+
+        auto prefix = logdir + "/" + std::string(time_str) + "_" + process_flag_file_name + "_" + file_name_
+            + "_" + level_name;
+
+        // 重启后同一小时的文件可能已写满，跳到第一个未满的分片
+        auto rotate_bytes = md->rotate_bytes_.load(std::memory_order_relaxed);
+        std::uint64_t exist_bytes = 0;
+        while (true)
+        {
+            sink.full_filename_ = part ? prefix + "." + std::to_string(part) + ".log" : prefix + ".log";
+            std::error_code ec;
+            auto size = std::filesystem::file_size(sink.full_filename_, ec);
+            exist_bytes = ec ? 0 : size;
+            if (!rotate_bytes || exist_bytes < rotate_bytes)
+            {
+                break;
+            }
+            ++part;
+        }
+        sink.part_ = part;
+        sink.file_bytes_ = exist_bytes;
+
+        auto mmap_chunk = md->mmap_chunk_.load(std::memory_order_relaxed);
+    #ifndef _WIN32
+        if (mmap_chunk)
+        {
+            // 映射需要读写打开，且不能用O_APPEND（预分配区在文件结尾之内）
+            int fd = ::open(sink.full_filename_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            sink.fp_ = fd >= 0 ? ::fdopen(fd, "r+b") : nullptr;
+            if (fd >= 0 && !sink.fp_)
+            {
+                ::close(fd);
+            }
+            if (sink.fp_)
+            {
+                sink.open_map(mmap_chunk);
+            }
+        }
+        else
+    #endif
+        {
+            sink.fp_ = std::fopen(sink.full_filename_.c_str(), "ab");
+        }
+        if (!sink.fp_)
+        {
+            std::cout << "日志文件打开失败：" << sink.full_filename_ << std::endl;
+        }
+        md->retention_.rotated(closed_file, sink.fp_ ? sink.full_filename_ : std::string());
+    }
+
     
+    // 由1970-01-01起的天数换算公历日期（Howard Hinnant civil_from_days）
+    static inline void civil_from_days(std::int64_t z, int& y, int& m, int& d)
+    {
+        z += 719468;
+        std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        auto doe = (std::uint64_t)(z - era * 146097);
+        auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        auto mp = (5 * doy + 2) / 153;
+        d = (int)(doy - (153 * mp + 2) / 5 + 1);
+        m = (int)(mp < 10 ? mp + 3 : mp - 9);
+        y = (int)((std::int64_t)yoe + era * 400 + (m <= 2));
+    }
+
+    static inline std::int64_t days_from_civil(int y, int m, int d)
+    {
+        y -= m <= 2;
+        std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+        auto yoe = (std::uint64_t)(y - era * 400);
+        auto doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        auto doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (std::int64_t)doe - 719468;
+    }
+
+    bool log_clock::split(std::uint64_t time_sec, civil_time& out)
+    {
+        bool is_refresh = time_sec < valid_begin_ || time_sec >= valid_end_;
+        if (is_refresh)
+        {
+            // 每15分钟按localtime重新计算一次时区偏移（时区偏移均为15分钟的整数倍），覆盖夏令时切换
+            time_t t = (time_t)time_sec;
+            struct tm tm_info;
+            safe_localtime(&t, &tm_info);
+            auto local = days_from_civil(tm_info.tm_year + 1900, tm_info.tm_mon + 1, tm_info.tm_mday) * 86400
+                + tm_info.tm_hour * 3600 + tm_info.tm_min * 60 + tm_info.tm_sec;
+            tz_offset_ = local - (std::int64_t)time_sec;
+            valid_begin_ = time_sec - time_sec % 900;
+            valid_end_ = valid_begin_ + 900;
+        }
+
+        auto local = (std::int64_t)time_sec + tz_offset_;
+        auto days = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+        auto secs = (int)(local - days * 86400);
+        civil_from_days(days, out.year, out.mon, out.day);
+        out.hour = secs / 3600;
+        out.min = secs / 60 % 60;
+        out.sec = secs % 60;
+        return is_refresh;
+    }
+
+    static inline char* put_digits(char* p, unsigned v, int width)
+    {
+        for (int i = width - 1; i >= 0; --i)
+        {
+            p[i] = (char)('0' + v % 10);
+            v /= 10;
+        }
+        return p + width;
+    }
+
+    static inline char* put_str(char* p, char* end, const char* s, std::size_t n)
+    {
+        n = std::min(n, (std::size_t)(end - p));
+        std::memcpy(p, s, n);
+        return p + n;
+    }
+
+    // 行头：[未决数] [YYYY-MM-DD HH:MM:SS.mmm] [文件-等级] [线程名] >> 
+    //    未决数之后的部分按（秒，线程，等级）缓存，命中时只改写毫秒
+    std::size_t log_file::make_header(log_item* item, int pending_count, char* out)
+    {
+        auto md = get_mdata();
+        auto sec = item->time / 1000;
+        if (sec != hdr_sec_ || item->tid != hdr_tid_ || item->level != hdr_level_)
+        {
+            civil_time ct;
+            if (md->clock_.split(sec, ct))
+            {
+                // 线程名可能变更，随时区偏移定期重取
+                md->tnames_.clear();
+            }
+
+            auto it = md->tnames_.find(item->tid);
+            if (it == md->tnames_.end())
+            {
+                auto name = athd::gettname(item->tid);
+                it = md->tnames_.emplace(item->tid, name ? name : "").first;
+            }
+
+            char* p = hdr_;
+            char* end = hdr_ + sizeof(hdr_);
+            p = put_str(p, end, "] [", 3);
+            p = put_digits(p, ct.year, 4);
+            *p++ = '-';
+            p = put_digits(p, ct.mon, 2);
+            *p++ = '-';
+            p = put_digits(p, ct.day, 2);
+            *p++ = ' ';
+            p = put_digits(p, ct.hour, 2);
+            *p++ = ':';
+            p = put_digits(p, ct.min, 2);
+            *p++ = ':';
+            p = put_digits(p, ct.sec, 2);
+            *p++ = '.';
+            hdr_ms_pos_ = p - hdr_;
+            p = put_digits(p, 0, 3);
+            p = put_str(p, end, "] [", 3);
+            p = put_str(p, end, file_name_upper_.data(), file_name_upper_.size());
+            p = put_str(p, end, "-", 1);
+            p = put_str(p, end, level_names_upper[item->level].data(), 3);
+            p = put_str(p, end, "] [", 3);
+            p = put_str(p, end, it->second.data(), it->second.size());
+            p = put_str(p, end, "] >> ", 5);
+
+            hdr_len_ = p - hdr_;
+            hdr_hour_ = ct.hour;
+            hdr_sec_ = sec;
+            hdr_tid_ = item->tid;
+            hdr_level_ = item->level;
+        }
+        put_digits(hdr_ + hdr_ms_pos_, (unsigned)(item->time % 1000), 3);
+
+        char* p = out;
+        *p++ = '[';
+        unsigned pending = pending_count == 0 ? 0 : pending_count - 1;
+        auto r = std::to_chars(p, p + 16, pending);
+        if (r.ptr - p < 2)
+        {
+            p[1] = p[0];
+            p[0] = '0';
+            r.ptr = p + 2;
+        }
+        p = r.ptr;
+        std::memcpy(p, hdr_, hdr_len_);
+        return (p - out) + hdr_len_;
+    }
+
     void log_file::write(log_item* item, int pending_count, bool out_screen, bool print_sys_to_screen,
         const std::string logdir, const std::string& process_flag_file_name)
     {
-        time_t time_sec = item->time / 1000;
-        struct tm tm_info;
-        safe_localtime(&time_sec, &tm_info);
+        auto md = get_mdata();
+        auto& buf = md->buf_;
+        char* begin = buf.data();
+
+        std::size_t header_len = make_header(item, pending_count, begin);
+        std::size_t total_len  = header_len + item->size;
+        md->live_.put(item, this);
+
+        // 整点切换文件
+        auto hour = hdr_hour_;
+
+        auto is_split = md->split_level_.load(std::memory_order_relaxed);
+        auto& sink = is_split ? sinks_[item->level] : sinks_[0];
+        // 超过大小切到下一个分片
+        auto rotate_bytes = md->rotate_bytes_.load(std::memory_order_relaxed);
+        auto is_full = rotate_bytes && sink.fp_ && sink.file_bytes_ && sink.file_bytes_ + total_len > rotate_bytes;
+        if (sink.hour_ != hour || !sink.fp_ || is_full)
+        {
+            auto part = sink.hour_ != hour ? 0 : sink.part_ + (is_full ? 1 : 0);
+            rotate_file(sink, (time_t)(item->time / 1000), hour, part, is_split ? level_names[item->level].c_str() : "all", logdir, process_flag_file_name);
+        }
+        auto fp = sink.fp_;
+
+        // 先进本文件的批缓冲，批结束时一次写入（见mdata::commit_files）；内存映射写时直接拷贝进映射区
+        if (fp)
+        {
+            sink.put(begin, header_len);
+            sink.put(item->context, item->size);
+            if (item->frame_count)
+            {
+                auto& trace = md->trace_text(item, sink);
+                sink.put(trace.data(), trace.size());
+            }
+            if (item->level == LEVEL_ERROR)
+            {
+                sink.has_error_ = true;
+            }
+            if (!sink.is_dirty_)
+            {
+                sink.is_dirty_ = true;
+                get_mdata()->dirty_sinks_.push_back(&sink);
+            }
+            if (sink.wbuf_.size() >= wbuf_limit)
+            {
+                sink.flush();
+            }
+        }
+        
+        if (fp && !(out_screen && (!is_sys_ || print_sys_to_screen)))
+        {
+            return;
+        }
+        if (total_len <= buf.size() - 1)
+        {
+            std::memcpy(begin + header_len, item->context, item->size);
+            begin[total_len] = 0;
+            std::cout << begin;
+        }
+        else
+        {
+            begin[header_len] = 0;
+            std::cout << begin << item->context;
+        }
+        if (item->frame_count)
+        {
+            std::cout << (fp ? md->trace_buf_ : md->trace_text(item, sink));
+        }
+    }
+
+    void log_sink::put(const char* p, std::size_t size)
+    {
+        file_bytes_ += size;
+    #ifndef _WIN32
+        std::size_t copied = 0;
+        while (map_chunk_ && copied < size)
+        {
+            if (tail_ >= map_off_ + map_size_ && !map_next())
+            {
+                break;
+            }
+            auto n = std::min<std::uint64_t>(size - copied, map_off_ + map_size_ - tail_);
+            std::memcpy(map_ + (tail_ - map_off_), p + copied, n);
+            tail_ += n;
+            copied += n;
+        }
+        unsynced_bytes_ += copied;
+        p += copied;
+        size -= copied;
+    #endif
+        if (size)
+        {
+            wbuf_.append(p, size);
+        }
+    }
+
+    // fp_已以读写方式打开：上次崩溃留下的预分配尾部全为0，从后往前找到有效结尾，首次put时再映射
+    void log_sink::open_map(std::uint64_t chunk_bytes)
+    {
+    #ifndef _WIN32
+        int fd = fileno(fp_);
+        struct stat st;
+        tail_ = ::fstat(fd, &st) == 0 ? (std::uint64_t)st.st_size : 0;
+        char block[4096];
+        while (tail_)
+        {
+            auto n = std::min<std::uint64_t>(tail_, sizeof(block));
+            if (::pread(fd, block, n, tail_ - n) != (ssize_t)n)
+            {
+                break;
+            }
+            auto i = n;
+            while (i && !block[i - 1])
+            {
+                --i;
+            }
+            tail_ -= n - i;
+            if (i)
+            {
+                break;
+            }
+        }
+        map_chunk_ = chunk_bytes;
+        map_off_ = tail_;
+        map_size_ = 0;
+        file_bytes_ = tail_;
+    #endif
+    }
+
+    // 映射下一块：先fallocate预分配（避免磁盘满时缺页SIGBUS），失败则截掉预分配部分退回stdio写
+    bool log_sink::map_next()
+    {
+    #ifndef _WIN32
+        int fd = fileno(fp_);
+        if (map_)
+        {
+            ::munmap(map_, map_size_);
+            map_ = nullptr;
+        }
+        static const std::uint64_t page_size = (std::uint64_t)::sysconf(_SC_PAGESIZE);
+        map_off_ = tail_ & ~(page_size - 1);
+        map_size_ = map_chunk_;
+        if (::fallocate(fd, 0, map_off_, map_size_) == 0)
+        {
+            auto addr = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map_off_);
+            if (addr != MAP_FAILED)
+            {
+                map_ = static_cast<char*>(addr);
+                return true;
+            }
+        }
+        std::cout << "日志文件映射失败，改用stdio写：" << full_filename_ << " " << std::strerror(errno) << std::endl;
+        map_size_ = 0;
+        map_chunk_ = 0;
+        if (::ftruncate(fd, tail_) != 0)
+        {
+            std::cout << "截掉预分配部分失败：" << full_filename_ << " " << std::strerror(errno) << std::endl;
+        }
+        // 流不带O_APPEND：无论截断是否成功都要定位到已写末尾，否则从文件头覆盖
+        std::fseek(fp_, (long)tail_, SEEK_SET);
+    #endif
+        return false;
+    }
+
+    void log_sink::flush()
+    {
+        if (!fp_ || wbuf_.empty())
+        {
+            return;
+        }
+        std::fwrite(wbuf_.data(), 1, wbuf_.size(), fp_);
+        std::fflush(fp_);
+        unsynced_bytes_ += wbuf_.size();
+        wbuf_.clear();
+    }
+
+    void log_sink::sync(std::uint64_t now_ms)
+    {
+        if (fp_)
+        {
+            #ifdef _WIN32
+                ::_commit(_fileno(fp_));
+            #else
+                ::fdatasync(fileno(fp_));
+            #endif
+        }
+        unsynced_bytes_ = 0;
+        last_sync_ms_ = now_ms;
+        has_error_ = false;
+    }
+
+    bool log_sink::need_sync(int mode, std::uint64_t now_ms, std::uint64_t sync_ms, std::size_t sync_bytes)
+    {
+        if (!unsynced_bytes_)
+        {
+            return false;
+        }
+        if (mode == SYNC_ERROR)
+        {
+            return has_error_;
+        }
+        if (mode == SYNC_INTERVAL)
+        {
+            return unsynced_bytes_ >= sync_bytes || now_ms - last_sync_ms_ >= sync_ms;
+        }
+        return false;
+    }
+
+    void log_sink::close()
+    {
+    #ifndef _WIN32
+        if (fp_ && map_chunk_)
+        {
+            // 截掉未用的预分配部分
+            if (map_)
+            {
+                ::munmap(map_, map_size_);
+            }
+            if (::ftruncate(fileno(fp_), tail_) != 0)
+            {
+                std::cout << "日志文件截断失败：" << full_filename_ << std::endl;
+            }
+            map_ = nullptr;
+            map_size_ = 0;
+            map_chunk_ = 0;
+        }
+    #endif
+        if (fp_)
+        {
+            std::fclose(fp_);
+            fp_ = nullptr;
+        }
+    }
+
+    // 每批日志处理完：各文件一次写入，按策略落盘
+    //    is_final：退出前，未落盘的全部落盘
+    inline void mdata::commit_files(bool is_final)
+    {
+        if (dirty_sinks_.empty())
+        {
+            return;
+        }
+        auto now = atime::msec();
+        int mode = sync_mode_;
+        std::size_t n = 0;
+        for (auto f : dirty_sinks_)
+        {
+            f->flush();
+            if (f->need_sync(mode, now, sync_ms_, sync_bytes_) || (is_final && mode != SYNC_NONE && f->unsynced_bytes_))
+            {
+                f->sync(now);
+            }
+            if (mode == SYNC_INTERVAL && f->unsynced_bytes_)
+            {
+                // 仍有未落盘内容，留待下次检查
+                dirty_sinks_[n++] = f;
+                continue;
+            }
+            f->unsynced_bytes_ = 0;
+            f->has_error_ = false;
+            f->is_dirty_ = false;
+        }
+        dirty_sinks_.resize(n);
+    }
+    
+    // ---------------------------- 线程日志环 ------------------------------
+
+    log_ring::log_ring(std::size_t capacity, std::uint64_t tid)
+    {
+        cap_ = capacity;
+        mask_ = capacity - 1;
+        tid_ = tid;
+        buf_ = new char[capacity];
+    }
+
+    log_ring::~log_ring()
+    {
+        delete[] buf_;
+    }
+
+    log_item* log_ring::reserve(std::size_t bytes)
+    {
+        std::size_t size = (sizeof(ring_rec) + bytes + 7) & ~std::size_t(7);
+        auto pos = write_pos_.load(std::memory_order_relaxed);
+        std::size_t tail_room = cap_ - (pos & mask_);
+        std::size_t need = size <= tail_room ? size : tail_room + size;
+        if (need > cap_ - (pos - cached_read_))
+        {
+            cached_read_ = read_pos_.load(std::memory_order_acquire);
+            if (need > cap_ - (pos - cached_read_))
+            {
+                return nullptr;
+            }
+        }
+
+        if (size > tail_room)
+        {
+            auto pad = reinterpret_cast<ring_rec*>(buf_ + (pos & mask_));
+            pad->size = (std::uint32_t)tail_room;
+            pad->is_pad = 1;
+            pos += tail_room;
+        }
+
+        auto rec = reinterpret_cast<ring_rec*>(buf_ + (pos & mask_));
+        rec->size = (std::uint32_t)size;
+        rec->is_pad = 0;
+        reserve_end_ = pos + size;
+        return reinterpret_cast<log_item*>(rec + 1);
+    }
+
+    void log_ring::commit()
+    {
+        write_count_.store(write_count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        write_pos_.store(reserve_end_, std::memory_order_release);
+    }
+
+    void log_ring::push_spill(log_item* item)
+    {
+        std::lock_guard<std::mutex> lk(spill_mtx_);
+        if (spill_tail_)
+        {
+            spill_tail_->next = item;
+        }
+        else
+        {
+            spill_head_ = item;
+        }
+        spill_tail_ = item;
+        spilling_.store(true, std::memory_order_release);
+    }
+
+    std::uint64_t log_ring::snapshot()
+    {
+        if (!spilling_.load(std::memory_order_acquire))
+        {
+            limit_pos_ = write_pos_.load(std::memory_order_acquire);
+            return write_count_.load(std::memory_order_relaxed) - read_count_;
+        }
+
+        // 先取溢出链表再定本批环的边界：生产者提交环内记录先于置位spilling_，
+        //    溢出期间不再写环，所以溢出之前的环内记录都在本批，溢出记录都晚于它们；
+        //    spilling_清除后才写的环内记录留给下一批
+        std::lock_guard<std::mutex> lk(spill_mtx_);
+        spill_batch_ = spill_head_;
+        spill_head_ = nullptr;
+        spill_tail_ = nullptr;
+        limit_pos_ = write_pos_.load(std::memory_order_acquire);
+        std::uint64_t count = write_count_.load(std::memory_order_relaxed) - read_count_;
+        spilling_.store(false, std::memory_order_release);
+        for (auto it = spill_batch_; it; it = it->next)
+        {
+            count++;
+        }
+        return count;
+    }
+
+    log_item* log_ring::peek()
+    {
+        auto pos = read_pos_.load(std::memory_order_relaxed);
+        while (pos < limit_pos_)
+        {
+            auto rec = reinterpret_cast<ring_rec*>(buf_ + (pos & mask_));
+            if (!rec->is_pad)
+            {
+                return reinterpret_cast<log_item*>(rec + 1);
+            }
+            pos += rec->size;
+            read_pos_.store(pos, std::memory_order_release);
+        }
+        return spill_batch_;
+    }
+
+    void log_ring::pop()
+    {
+        auto pos = read_pos_.load(std::memory_order_relaxed);
+        if (pos < limit_pos_)
+        {
+            auto rec = reinterpret_cast<ring_rec*>(buf_ + (pos & mask_));
+            read_count_++;
+            read_pos_.store(pos + rec->size, std::memory_order_release);
+            return;
+        }
+        auto item = spill_batch_;
+        spill_batch_ = item->next;
+        free(item);
+    }
+
+    bool log_ring::has_data() const
+    {
+        return read_pos_.load(std::memory_order_relaxed) != write_pos_.load(std::memory_order_acquire)
+            || spilling_.load(std::memory_order_acquire);
+    }
+
+    // 线程退出时关闭本线程的环，由日志线程读完后释放
+    struct ring_holder
+    {
+        log_ring* ring_ = nullptr;
+        ~ring_holder();
+    };
+    static thread_local ring_holder tl_ring_;
+    static thread_local bool tl_ring_closed_ = false;
+    static thread_local std::uint64_t tl_seq_ = 0;
+
+    ring_holder::~ring_holder()
+    {
+        tl_ring_closed_ = true;
+        if (ring_)
+        {
+            ring_->closed_.store(true, std::memory_order_release);
+            ring_ = nullptr;
+            get_mdata()->wake();
+        }
+    }
+
+    static log_ring* get_ring()
+    {
+        if (tl_ring_closed_)
+        {
+            return nullptr;
+        }
+        if (!tl_ring_.ring_)
+        {
+            tl_ring_.ring_ = get_mdata()->new_ring();
+        }
+        return tl_ring_.ring_;
+    }
+
+    log_ring* mdata::new_ring()
+    {
+        std::size_t size = 4096;
+        while (size < ring_size_)
+        {
+            size <<= 1;
+        }
+        auto ring = new log_ring(size, athd::getctid());
+        std::lock_guard<std::mutex> lk(ring_mtx_);
+        rings_.push_back(ring);
+        return ring;
+    }
+
+    // 生产者提交后调用：日志线程在等待时才进锁唤醒
+    void mdata::wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (is_waiting_.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            cv_.notify_one();
+        }
+    }
+
+    mdata::mdata()
+    {
+        is_runing_ = true;
+        work_thread_ = std::thread(&mdata::process_logs, this);
+        log_files_.emplace_back(new log_file("sys"));
+        log_files_[0]->is_sys_ = true;
+    }
+
+    mdata::~mdata()
+    {
+        stop();
+    }
+
+    inline void mdata::stop()
+    {
+        if (!is_runing_)
+        {
+            return;
+        }
+        is_runing_ = false;
+
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            cv_.notify_one();
+        }
+
+        if (work_thread_.joinable())
+        {
+            work_thread_.join();
+        }
+        // 仍在运行的线程可能还持有环，不释放
+    }
+
+    inline bool mdata::rings_ready()
+    {
+        std::lock_guard<std::mutex> lk(ring_mtx_);
+        for (auto r : rings_)
+        {
+            if (r->has_data() || r->closed_.load(std::memory_order_acquire))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 等待日志，返回溢出链表（各线程的环在merge_items中读取）
+    inline std::tuple<log_item*, log_item*, int> mdata::get_items()
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        auto has_items = [this]
+            {
+                return (is_settings_ && (head_ != nullptr || rings_ready())) || !is_runing_;
+            };
+
+        is_waiting_.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!dirty_sinks_.empty())
+        {
+            // 有未落盘内容时定时醒来检查
+            cv_.wait_for(lk, std::chrono::milliseconds(sync_ms_.load()), has_items);
+        }
+        else if (has_suppressed_.load(std::memory_order_relaxed) || has_overload_.load(std::memory_order_relaxed))
+        {
+            // 有待汇总的抑制/丢弃计数
+            cv_.wait_for(lk, std::chrono::milliseconds(1000), has_items);
+        }
+        else
+        {
+            cv_.wait(lk, has_items);
+        }
+        is_waiting_.store(false, std::memory_order_relaxed);
+
+        log_item* h = (log_item*)head_;
+        log_item* t = (log_item*)tail_;
+        head_ = nullptr;
+        tail_ = nullptr;
+
+        return {h, t, item_count_};
+    }
+
+    template<typename V>
+    static inline bool read_bin(const char*& p, const char* end, V& v)
+    {
+        if ((std::size_t)(end - p) < sizeof(v))
+        {
+            return false;
+        }
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return true;
+    }
+
+    // 按格式串还原二进制记录，输出与调用线程格式化（pvt::format_to）一致
+    log_item* mdata::decode_item(log_item* item)
+    {
+        constexpr std::size_t max_text = 1024 * 1024;
+        if (decode_buf_.size() < sizeof(log_item) + max_text + 3)
+        {
+            decode_buf_.resize(sizeof(log_item) + max_text + 3);
+        }
+        auto out = reinterpret_cast<log_item*>(decode_buf_.data());
+        std::memcpy(out, item, sizeof(log_item));
+        out->is_binary = false;
+        out->frame_count = 0;
+
+        const char* p = item->context;
+        const char* end = p + item->size;
+        pvt::bin_head head;
+        if (!read_bin(p, end, head))
+        {
+            head.fmt_ = "";
+            head.fmt_size_ = 0;
+            head.argc_ = 0;
+        }
+
+        pvt::writer w(out->context, max_text);
+        std::string_view fmt(head.fmt_, head.fmt_size_);
+        std::size_t from = 0;
+        for (std::uint32_t i = 0; i < head.argc_; ++i)
+        {
+            auto to = fmt.find("{}", from);
+            if (to == std::string_view::npos)
+            {
+                break;
+            }
+            w.put(fmt.data() + from, to - from);
+            from = to + 2;
+
+            char tag = 0;
+            if (!read_bin(p, end, tag))
+            {
+                break;
+            }
+            if (tag == pvt::BIN_INT)
+            {
+                std::int64_t v = 0;
+                read_bin(p, end, v);
+                pvt::put_arg(w, v);
+            }
+            else if (tag == pvt::BIN_UINT)
+            {
+                std::uint64_t v = 0;
+                read_bin(p, end, v);
+                pvt::put_arg(w, v);
+            }
+            else if (tag == pvt::BIN_FLOAT)
+            {
+                double v = 0;
+                read_bin(p, end, v);
+                pvt::put_arg(w, v);
+            }
+            else if (tag == pvt::BIN_STR)
+            {
+                std::uint32_t n = 0;
+                read_bin(p, end, n);
+                n = std::min<std::uint32_t>(n, end - p);
+                w.put(p, n);
+                p += n;
+            }
+            else if (tag == pvt::BIN_PTR)
+            {
+                std::uint64_t v = 0;
+                read_bin(p, end, v);
+                pvt::put_arg(w, reinterpret_cast<const void*>(static_cast<std::uintptr_t>(v)));
+            }
+            else
+            {
+                break;
+            }
+        }
+        w.put(fmt.data() + from, fmt.size() - from);
+
+        std::size_t idx = w.ptr() - out->context;
+        out->context[idx++] = '\r';
+        out->context[idx++] = '\n';
+        out->context[idx] = 0;
+        out->size = idx;
+        return out;
+    }
+
+    inline void mdata::process_item(log_item* item, int pending_count)
+    {
+        log_file* file = nullptr;
+        if (item->file)
+        {
+            file = static_cast<log_file*>(item->file);
+        }
+        else
+        {
+            file = log_files_[0].get();
+        }
+        if (item->is_binary)
+        {
+            item = decode_item(item);
+        }
+        try
+        {
+            file->write(item, pending_count, print_screen_, print_sys_log_to_screen_, root_dir_, process_flag_file_name_);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << "写日志错误：" << e.what() << '\n' << item->context << std::endl;
+        }
+        catch(...)
+        {
+            std::cerr << "写日志错误: " << '\n' << item->context << std::endl;
+        }
+    }
+
+    // 调用栈文本：同一文件内首次出现时输出"[stack #编号]"及各帧，之后只输出编号
+    const std::string& mdata::trace_text(log_item* item, log_sink& sink)
+    {
+        trace_buf_.clear();
+        if (!item->frame_count)
+        {
+            return trace_buf_;
+        }
+        std::uint64_t frames[64];
+        auto n = std::min<std::size_t>(item->frame_count, 64);
+        std::memcpy(frames, item->context + item->size + 1, n * sizeof(std::uint64_t));
+
+        std::uint64_t h = 14695981039346656037ull;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            h = (h ^ frames[i]) * 1099511628211ull;
+        }
+        if (stack_ids_.size() >= 65536)
+        {
+            stack_ids_.clear();
+        }
+        auto it = stack_ids_.find(h);
+        if (it == stack_ids_.end())
+        {
+            it = stack_ids_.emplace(h, ++next_stack_id_).first;
+        }
+        auto id = it->second;
 
-        if (last_level_ != item->level || hour_ != tm_info.tm_hour || !fp_)
+        trace_buf_ = "[stack #";
+        trace_buf_ += std::to_string(id);
+        trace_buf_ += "]\r\n";
+        if (!sink.traced_.insert(id).second)
+        {
+            return trace_buf_;
+        }
+    #ifndef _WIN32
+        char tmp[4096];
+        for (std::size_t i = 0; i < n; ++i)
         {
-            hour_ = tm_info.tm_hour;
-            last_level_ = item->level;
-            rotate_file(&tm_info, item->level, logdir, process_flag_file_name);
+            auto len = symbolize_to_buf(tmp, sizeof(tmp), 0, frames[i]);
+            trace_buf_.append(tmp, len);
         }
+    #endif
+        return trace_buf_;
+    }
 
-        auto& buf = get_mdata()->buf_;        // std::array<char,2048>
-        char* begin = buf.data();
-        char* end   = begin + buf.size();
-
-        // 使用 format_to_n，防止溢出；返回实际写到的尾后指针
-        auto result = std::format_to_n(
-            begin, buf.size(),
-            "[{:02d}] [{:04d}-{:02d}-{:02d} {:02d}:{:02d}:{:02d}.{:03d}] [{}-{}] [{}] >> ",
-            pending_count==0?0:pending_count-1,
-            tm_info.tm_year + 1900,
-            tm_info.tm_mon  + 1,
-            tm_info.tm_mday,
-            tm_info.tm_hour,
-            tm_info.tm_min,
-            tm_info.tm_sec,
-            static_cast<int>(item->time % 1000),
-            file_name_upper_,
-            level_names_upper[item->level],
-            athd::gettname(item->tid)
-        );
-
-        std::size_t header_len = result.size;
-        std::size_t total_len  = header_len + item->size;
-        
-        if (total_len <= buf.size() - 1)
+    // 开放寻址，最多探测16个槽，表满时不限流
+    site_slot* mdata::find_site(std::uint64_t key, void* file, int level, const char* desc, std::size_t desc_size)
+    {
+        auto h = key * 0x9E3779B97F4A7C15ull;
+        for (std::size_t i = 0; i < 16; ++i)
         {
-            // 如果 header + context 能放进缓冲区，则合并一次写
-            std::memcpy(begin + header_len, item->context, item->size);
-            begin[total_len] = 0;
-            if (fp_)
+            auto& slot = sites_[((h >> 32) + i) & (site_count - 1)];
+            auto k = slot.key_.load(std::memory_order_acquire);
+            if (k == key)
             {
-                std::fwrite(begin, 1, total_len, fp_);
+                return &slot;
             }
-            if (!fp_ || (out_screen && (!is_sys_ || print_sys_to_screen)))
+            if (k)
             {
-                std::cout << begin;
+                continue;
             }
-        }
-        else
-        {
-            // 放不下就分两次写
-            begin[header_len] = 0;
-            if (fp_)
+            std::uint64_t expected = 0;
+            if (slot.key_.compare_exchange_strong(expected, key, std::memory_order_acq_rel))
             {
-                std::fwrite(begin, 1, header_len, fp_);
-                std::fwrite(item->context, 1, item->size, fp_);
+                slot.file_ = file;
+                slot.level_ = level;
+                auto n = std::min(desc_size, sizeof(slot.desc_) - 1);
+                std::memcpy(slot.desc_, desc, n);
+                slot.desc_[n] = 0;
+                slot.ready_.store(true, std::memory_order_release);
+                return &slot;
             }
-            if (!fp_ || (out_screen && (!is_sys_ || print_sys_to_screen)))
+            if (expected == key)
             {
-                std::cout << begin << item->context;
+                return &slot;
             }
         }
-        if (fp_)
+        return nullptr;
+    }
+
+    int mdata::admit(void* file, int level, std::uint64_t key, const char* desc, std::size_t desc_size)
+    {
+        bool is_trace = level == LEVEL_ERROR && print_stack_on_error;
+        auto interval = site_interval_ns_.load(std::memory_order_relaxed);
+        auto window = trace_window_ms_.load(std::memory_order_relaxed);
+        if (!key || (!interval && (!is_trace || !window)))
         {
-            std::fflush(fp_);
-            #ifdef _WIN32
-                ::_commit(_fileno(fp_));  // Windows 立即落盘
-            #else
-                ::fsync(fileno(fp_));     // POSIX 立即落盘
-            #endif
+            return ADMIT_PASS | (is_trace ? ADMIT_TRACE : 0);
+        }
+        auto slot = find_site(key, file, level, desc, desc_size);
+        if (!slot)
+        {
+            return ADMIT_PASS | (is_trace ? ADMIT_TRACE : 0);
+        }
+
+        if (interval)
+        {
+            // GCRA：tat超前当前时间超过突发容差即抑制
+            auto now = atime::nsec();
+            auto tolerance = site_tolerance_ns_.load(std::memory_order_relaxed);
+            auto tat = slot->tat_.load(std::memory_order_relaxed);
+            while (true)
+            {
+                auto base = std::max<std::uint64_t>(tat, now);
+                if (base - now > tolerance)
+                {
+                    slot->suppressed_.fetch_add(1, std::memory_order_relaxed);
+                    slot->tid_.store(athd::getctid(), std::memory_order_relaxed);
+                    if (!has_suppressed_.load(std::memory_order_relaxed))
+                    {
+                        has_suppressed_.store(true, std::memory_order_relaxed);
+                    }
+                    if (level == LEVEL_WARNING)
+                    {
+                        warning_count_++;
+                    }
+                    else if (level == LEVEL_ERROR)
+                    {
+                        error_count_++;
+                    }
+                    return 0;
+                }
+                if (slot->tat_.compare_exchange_weak(tat, base + interval, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+        }
+
+        if (is_trace && window)
+        {
+            auto now_ms = atime::msec();
+            auto last = slot->trace_ms_.load(std::memory_order_relaxed);
+            is_trace = (last == 0 || now_ms - last >= window)
+                && slot->trace_ms_.compare_exchange_strong(last, now_ms, std::memory_order_relaxed);
         }
+        return ADMIT_PASS | (is_trace ? ADMIT_TRACE : 0);
     }
-    
-    mdata::mdata()
+
+    // 日志线程自己生成的汇总行（限流、超预算），写入summary_buf_后直接写出
+    static constexpr std::size_t synthetic_text = 256;
+
+    log_item* mdata::synthetic_item(void* file, int level, std::uint64_t tid, std::uint64_t now)
     {
-        is_runing_ = true;
-        work_thread_ = std::thread(&mdata::process_logs, this);
-        log_files_.emplace_back(new log_file("sys"));
-        log_files_[0]->is_sys_ = true;
+        if (summary_buf_.size() < sizeof(log_item) + synthetic_text)
+        {
+            summary_buf_.resize(sizeof(log_item) + synthetic_text);
+        }
+        auto item = reinterpret_cast<log_item*>(summary_buf_.data());
+        item->next = nullptr;
+        item->tid = tid;
+        item->file = file;
+        item->level = static_cast<LogLevel>(level);
+        item->is_binary = false;
+        item->frame_count = 0;
+        item->time = now;
+        item->seq = 0;
+        return item;
     }
 
-    mdata::~mdata()
+    inline void mdata::write_synthetic(log_item* item, pvt::writer& w)
     {
-        stop();
+        w.put("\r\n", 2);
+        item->size = static_cast<int>(w.ptr() - item->context);
+        item->context[item->size] = 0;
+        process_item(item, 0);
     }
 
-    inline void mdata::stop()
+    // 输出被抑制日志的汇总行，每秒一次
+    inline void mdata::report_suppressed(bool is_final)
     {
-        if (!is_runing_)
+        if (!has_suppressed_.load(std::memory_order_relaxed) || !is_settings_)
         {
             return;
         }
-        is_runing_ = false;
+        auto now = atime::msec();
+        if (!is_final && now - last_sweep_ms_ < 1000)
+        {
+            return;
+        }
+        last_sweep_ms_ = now;
+        has_suppressed_.store(false, std::memory_order_relaxed);
 
+        for (auto& slot : sites_)
         {
-            auto item = static_cast<log_item*>(malloc(sizeof(log_item)));
-            item->next = nullptr;
-            item->time = 0;
-            std::lock_guard<std::mutex> lock(mtx_);            
-            if (head_) 
+            if (!slot.ready_.load(std::memory_order_acquire) || !slot.suppressed_.load(std::memory_order_relaxed))
             {
-                tail_->next = item;
-                tail_ = item;
+                continue;
             }
-            else
+            auto n = slot.suppressed_.exchange(0, std::memory_order_relaxed);
+            if (!n)
             {
-                head_ = item;
-                tail_ = item;
+                continue;
             }
-            cv_.notify_one();
+            auto item = synthetic_item(slot.file_, slot.level_, slot.tid_.load(std::memory_order_relaxed), now);
+            pvt::writer w(item->context, synthetic_text - 3);
+            w.put(slot.desc_, std::strlen(slot.desc_));
+            w.put(" (repeated ", 11);
+            w.put_chars(n);
+            w.put(" times)", 7);
+            write_synthetic(item, w);
         }
+    }
 
-        if (work_thread_.joinable())
+    // 超预算丢弃的汇总行，每秒最多一条，写入系统日志
+    inline void mdata::report_overload(bool is_final)
+    {
+        if (!has_overload_.load(std::memory_order_relaxed) || !is_settings_)
         {
-            work_thread_.join();
+            return;
         }
-        while(head_)
+        auto now = atime::msec();
+        if (!is_final && now - last_overload_ms_ < 1000)
         {
-            auto temp = head_;
-            head_ = head_->next;
-            delete temp;
+            return;
         }
-        head_ = nullptr;
+        last_overload_ms_ = now;
+        has_overload_.store(false, std::memory_order_relaxed);
+
+        std::uint64_t delta[4];
+        bool has_drop = false;
+        for (int i = 0; i < 4; ++i)
+        {
+            auto n = overload_drops_[i].load(std::memory_order_relaxed);
+            delta[i] = n - reported_drops_[i];
+            reported_drops_[i] = n;
+            has_drop = has_drop || delta[i];
+        }
+        if (!has_drop)
+        {
+            return;
+        }
+
+        auto item = synthetic_item(log_files_[0].get(), LEVEL_WARNING, athd::getctid(), now);
+        pvt::writer w(item->context, synthetic_text - 3);
+        w.put("日志队列超出预算（", sizeof("日志队列超出预算（") - 1);
+        w.put_chars(budget_.load(std::memory_order_relaxed));
+        w.put("字节），已丢弃 INFO=", sizeof("字节），已丢弃 INFO=") - 1);
+        w.put_chars(delta[LEVEL_INFO]);
+        w.put(" DEBUG=", 7);
+        w.put_chars(delta[LEVEL_DEBUG]);
+        w.put(" WARNING=", 9);
+        w.put_chars(delta[LEVEL_WARNING]);
+        w.put("，排队", sizeof("，排队") - 1);
+        w.put_chars(queued_count_.load(std::memory_order_relaxed));
+        w.put("条/", sizeof("条/") - 1);
+        w.put_chars(queued_bytes_.load(std::memory_order_relaxed));
+        w.put("字节", sizeof("字节") - 1);
+        write_synthetic(item, w);
     }
 
-    inline std::tuple<log_item*, log_item*, int> mdata::get_items()
+    // 按等级检查队列预算，返回false丢弃
+    bool mdata::admit_bytes(int level, std::size_t bytes)
     {
-        std::unique_lock<std::mutex> lk(mtx_);
-        cv_.wait(lk, 
-            [this]
+        auto budget = budget_.load(std::memory_order_relaxed);
+        if (!budget || level == LEVEL_ERROR)
+        {
+            return true;
+        }
+        auto limit = level == LEVEL_WARNING ? budget : budget / 4 * 3;
+        if (queued_bytes_.load(std::memory_order_relaxed) + bytes <= limit)
+        {
+            return true;
+        }
+        if (level == LEVEL_WARNING && overload_policy_ == OVERLOAD_BLOCK)
+        {
+            while (is_settings_ && is_runing_ && queued_bytes_.load(std::memory_order_relaxed) + bytes > limit)
+            {
+                wake();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (queued_bytes_.load(std::memory_order_relaxed) + bytes <= limit)
             {
-                return (head_ != nullptr && is_settings_) || !is_runing_;
+                return true;
             }
-        );
+        }
+        overload_drops_[level].fetch_add(1, std::memory_order_relaxed);
+        if (!has_overload_.load(std::memory_order_relaxed))
+        {
+            has_overload_.store(true, std::memory_order_relaxed);
+        }
+        return false;
+    }
 
-        log_item* h = (log_item*)head_;
-        log_item* t = (log_item*)tail_;
-        head_ = nullptr;
-        tail_ = nullptr;
+    // 记录占用的队列字节（与post_item的分配大小一致）
+    static inline std::size_t item_bytes(const log_item* item)
+    {
+        return sizeof(log_item) + item->size + (item->is_binary ? 0 : 1) + item->frame_count * sizeof(void*);
+    }
 
-        return {h, t, item_count_};
+    static inline bool item_before(const log_item* a, const log_item* b)
+    {
+        return a->time < b->time || (a->time == b->time && a->seq < b->seq);
     }
 
-    inline void mdata::process_item(log_item* item)
+    // 各线程环与溢出链表按时间戳k路归并写出
+    inline void mdata::merge_items(log_item* spill, int spill_count)
     {
-        log_file* file = nullptr;
-        if (item->file)
         {
-            file = static_cast<log_file*>(item->file);
+            std::lock_guard<std::mutex> lk(ring_mtx_);
+            sources_ = rings_;
         }
-        else
+
+        // 公共溢出链表按入队顺序，多线程之间时间可能交错，先排序
+        spills_.clear();
+        for (auto it = spill; it; it = it->next)
         {
-            file = log_files_[0].get();
+            spills_.push_back(it);
         }
-        try
+        std::stable_sort(spills_.begin(), spills_.end(), item_before);
+        std::size_t spill_idx = 0;
+
+        std::int64_t pending = spill_count;
+        for (auto r : sources_)
         {
-            file->write(item, item_count_, print_screen_, print_sys_log_to_screen_, root_dir_, process_flag_file_name_);
+            pending += (std::int64_t)r->snapshot();
         }
-        catch(const std::exception& e)
+
+        while (true)
         {
-            std::cerr << "写日志错误：" << e.what() << '\n' << item->context << std::endl;
+            log_item* best = nullptr;
+            log_ring* best_ring = nullptr;
+            for (auto r : sources_)
+            {
+                auto item = r->peek();
+                if (item && (!best || item_before(item, best)))
+                {
+                    best = item;
+                    best_ring = r;
+                }
+            }
+            if (spill_idx < spills_.size() && (!best || item_before(spills_[spill_idx], best)))
+            {
+                best = spills_[spill_idx];
+                best_ring = nullptr;
+            }
+            if (!best)
+            {
+                break;
+            }
+
+            process_item(best, pending > 0 ? (int)pending : 0);
+            pending--;
+            queued_bytes_.fetch_sub(item_bytes(best), std::memory_order_relaxed);
+            queued_count_.fetch_sub(1, std::memory_order_relaxed);
+
+            if (best_ring)
+            {
+                best_ring->pop();
+            }
+            else
+            {
+                spill_idx++;
+                item_count_--;
+                free(best);
+            }
         }
-        catch(...)
+    }
+
+    inline void mdata::free_closed_rings()
+    {
+        std::lock_guard<std::mutex> lk(ring_mtx_);
+        std::size_t n = 0;
+        for (auto r : rings_)
         {
-            std::cerr << "写日志错误: " << '\n' << item->context << std::endl;
+            if (r->closed_.load(std::memory_order_acquire) && !r->has_data())
+            {
+                exited_drop_count_ += r->drop_count_;
+                delete r;
+                continue;
+            }
+            rings_[n++] = r;
         }
+        rings_.resize(n);
     }
 
     // thread_signal_mask.cpp
     #include <signal.h>
     #include <pthread.h>
 
-    // 为当前线程屏蔽所有「会导致进程终止」的信号
+    // 为当前线程屏蔽所有「会导致进程终止」的信号；同步产生的致命信号屏蔽后内核直接结束进程，
+    //    保持不屏蔽，交给崩溃处理（见asig::set_crash_handler）
     inline void block_all_signals()
     {
     #ifndef _WIN32
         sigset_t full;
         sigfillset(&full);
+        for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL})
+        {
+            sigdelset(&full, sig);
+        }
         pthread_sigmask(SIG_BLOCK, &full, nullptr);
     #endif
     }
@@ -264,29 +1340,26 @@ namespace alog
     inline void mdata::process_logs()
     {
         block_all_signals();
+        asig::setup_altstack();
+        log_tid_ = athd::getctid();
         
         std::cout << "日志线程已启动，等待setroot..." << std::endl;
 
-        auto is_stop = false;
-        while (!is_stop || head_)
+        while (true)
         {
+            auto is_stop = !is_runing_;
             auto [head, tail, count] = get_items();
-
-            auto curr = head;
-            while(curr)
+            if (is_settings_ || !is_runing_)
             {
-                if (is_stop || !curr->time)
-                {
-                    is_stop = true;
-                }
-                else
-                {
-                    process_item(curr);
-                }
-                item_count_--;
-                auto next = curr->next;
-                free(curr);
-                curr = next;
+                merge_items(head, count);
+                free_closed_rings();
+            }
+            report_suppressed(is_stop);
+            report_overload(is_stop);
+            commit_files(is_stop);
+            if (is_stop)
+            {
+                break;
             }
         }
 
@@ -317,6 +1390,19 @@ AA_API void alog_setroot(const char* root, const char* process_flag)
     md->process_flag_file_name_ = process_flag_file_name;
     md->root_dir_ = dir;
 
+    md->retention_.setdir(dir, process_flag_file_name);
+    md->live_.open(process_flag, process_flag_file_name, md->live_bytes_);
+
+    // 崩溃文件路径前缀在这里生成，信号处理中不能分配内存
+    auto crash_path = dir + "/crash_" + process_flag_file_name;
+    auto n = std::min(crash_path.size(), sizeof(md->crash_path_) - 1);
+    std::memcpy(md->crash_path_, crash_path.data(), n);
+    md->crash_path_[n] = 0;
+#ifndef _WIN32
+    static auto is_crash_handler = (asig::set_crash_handler(alog::crash_dump), true);
+    (void)is_crash_handler;
+#endif
+
     md->is_settings_ = true;
     md->cv_.notify_one();
 }
@@ -364,6 +1450,18 @@ AA_API void alog_get_buf(char** pbuf, std::size_t* psize)
     *psize = max_size;
 }
 
+AA_API void alog_setsync(int mode, std::uint64_t ms, std::uint64_t bytes)
+{
+    auto md = alog::get_mdata();
+    if (mode < alog::SYNC_NONE || mode > alog::SYNC_ERROR)
+    {
+        mode = alog::SYNC_INTERVAL;
+    }
+    md->sync_mode_ = mode;
+    md->sync_ms_ = ms ? ms : 1000;
+    md->sync_bytes_ = bytes ? bytes : 1024 * 1024;
+}
+
 AA_API void* alog_addfile(const char* file_name)
 {
     auto md = alog::get_mdata();
@@ -375,31 +1473,94 @@ AA_API void* alog_addfile(const char* file_name)
     return ret;
 }
 
-AA_API void alog_print(void* file, int level, const char* txt_addr, std::size_t txt_size)
+// 文本记录末尾追加\r\n，二进制记录原样拷贝
+// frames：原始调用栈（仅文本记录），存放在内容结尾0之后
+static void post_item(void* file, int level, const char* txt_addr, std::size_t txt_size, bool is_binary,
+    void* const* frames = nullptr, int frame_count = 0)
 {
     auto md = alog::get_mdata();
     if (!md->is_runing_)
     {
         return;
     }
-    
-    auto item = static_cast<alog::log_item*>(malloc(sizeof(alog::log_item) + txt_size + 3));
+    if (level == alog::LEVEL_WARNING)
+    {
+        md->warning_count_++;
+    }
+    else if (level == alog::LEVEL_ERROR)
+    {
+        md->error_count_++;
+    }
+
+    auto bytes = sizeof(alog::log_item) + txt_size + (is_binary ? 0 : 3) + frame_count * sizeof(void*);
+    if (!md->admit_bytes(level, bytes))
+    {
+        return;
+    }
+    alog::log_item* item = nullptr;
+    auto ring = alog::get_ring();
+    if (ring && !ring->is_spilling() && bytes <= ring->max_record())
+    {
+        item = ring->reserve(bytes);
+        while (!item && md->ring_policy_ == alog::RING_BLOCK && md->is_settings_ && md->is_runing_)
+        {
+            md->wake();
+            std::this_thread::yield();
+            item = ring->reserve(bytes);
+        }
+        if (!item && md->ring_policy_ == alog::RING_DROP)
+        {
+            ring->drop_count_.fetch_add(1, std::memory_order_relaxed);
+            md->drop_count_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    auto is_spill = item == nullptr;
+    if (is_spill)
+    {
+        item = static_cast<alog::log_item*>(malloc(bytes));
+    }
     
     item->next = nullptr;
     item->tid = athd::getctid();
     item->file = file;
     item->level = static_cast<alog::LogLevel>(level);
+    item->is_binary = is_binary;
+    item->frame_count = static_cast<std::uint16_t>(frame_count);
     item->time = atime::msec();
+    item->seq = alog::tl_seq_++;
     auto buf = item->context;
     std::memcpy(buf, txt_addr, txt_size);
     auto idx = txt_size;
-    buf[idx++] = '\r';
-    buf[idx++] = '\n';
-    buf[idx] = 0;
+    if (!is_binary)
+    {
+        buf[idx++] = '\r';
+        buf[idx++] = '\n';
+        buf[idx] = 0;
+    }
     item->size = idx;
+    if (frame_count)
+    {
+        std::memcpy(buf + idx + 1, frames, frame_count * sizeof(void*));
+    }
+
+    md->queued_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    md->queued_count_.fetch_add(1, std::memory_order_relaxed);
+
+    if (!is_spill)
+    {
+        ring->commit();
+        md->wake();
+        return;
+    }
+    if (ring)
+    {
+        ring->push_spill(item);
+        md->wake();
+        return;
+    }
     
     std::lock_guard<std::mutex> lock(md->mtx_);
-    
     if (md->head_)
     {
         md->tail_->next = item;
@@ -411,18 +1572,155 @@ AA_API void alog_print(void* file, int level, const char* txt_addr, std::size_t
         md->tail_ = item;
     }
     md->item_count_++;
-    if (item->level == alog::LEVEL_WARNING)
+    md->cv_.notify_one();
+}
+
+AA_API void alog_print(void* file, int level, const char* txt_addr, std::size_t txt_size)
+{
+    post_item(file, level, txt_addr, txt_size, false);
+}
+
+AA_API void alog_print_binary(void* file, int level, const char* rec_addr, std::size_t rec_size)
+{
+    post_item(file, level, rec_addr, rec_size, true);
+}
+
+AA_API void alog_setratelimit(double per_sec, std::uint32_t burst, std::uint64_t trace_ms)
+{
+    auto md = alog::get_mdata();
+    std::uint64_t interval = per_sec > 0 ? static_cast<std::uint64_t>(1e9 / per_sec) : 0;
+    if (per_sec > 0 && !interval)
     {
-        md->warning_count_++;
+        interval = 1;
     }
-    else if (item->level == alog::LEVEL_ERROR)
+    md->site_interval_ns_ = interval;
+    md->site_tolerance_ns_ = interval * (burst ? burst - 1 : 0);
+    md->trace_window_ms_ = trace_ms;
+}
+
+AA_API int alog_admit(void* file, int level, std::uint64_t key, const char* desc, std::size_t desc_size)
+{
+    return alog::get_mdata()->admit(file, level, key, desc, desc_size);
+}
+
+AA_API void alog_print_traced(void* file, int level, const char* txt_addr, std::size_t txt_size, int start)
+{
+#ifdef _WIN32
+    // Windows仍在调用线程解析（DbgHelp）
+    std::string txt(txt_addr, txt_size);
+    char stack[8192];
+    auto n = alog_stack_trace_to_buf(stack, sizeof(stack), start + 1);
+    txt += "\r\n";
+    txt.append(stack, n);
+    post_item(file, level, txt.data(), txt.size(), false);
+#else
+    void* frames[64];
+    int n = ::backtrace(frames, 64);
+    start += 1;     // 跳过本函数
+    if (start > n)
     {
-        md->error_count_++;
+        start = n;
     }
-    md->cv_.notify_one();
+    post_item(file, level, txt_addr, txt_size, false, frames + start, n - start);
+#endif
+}
+
+AA_API void alog_setbudget(std::uint64_t bytes, int policy)
+{
+    auto md = alog::get_mdata();
+    md->budget_ = bytes;
+    md->overload_policy_ = policy == alog::OVERLOAD_BLOCK ? alog::OVERLOAD_BLOCK : alog::OVERLOAD_DROP;
+}
+
+AA_API void alog_getqueue(alog::queue_stats* out)
+{
+    auto md = alog::get_mdata();
+    out->count_ = md->queued_count_.load(std::memory_order_relaxed);
+    out->bytes_ = md->queued_bytes_.load(std::memory_order_relaxed);
+    out->budget_ = md->budget_.load(std::memory_order_relaxed);
+    out->drop_info_ = md->overload_drops_[alog::LEVEL_INFO].load(std::memory_order_relaxed);
+    out->drop_debug_ = md->overload_drops_[alog::LEVEL_DEBUG].load(std::memory_order_relaxed);
+    out->drop_warning_ = md->overload_drops_[alog::LEVEL_WARNING].load(std::memory_order_relaxed);
+}
+
+AA_API void alog_setbinary(bool v)
+{
+    alog::get_mdata()->is_binary_ = v;
+}
+
+AA_API bool alog_is_binary()
+{
+    return alog::get_mdata()->is_binary_.load(std::memory_order_relaxed);
+}
+
+AA_API void alog_setrotate(std::uint64_t max_bytes)
+{
+    alog::get_mdata()->rotate_bytes_ = max_bytes;
+}
+
+AA_API void alog_setretention(std::uint32_t max_files, std::uint64_t max_bytes, std::uint64_t max_age_sec)
+{
+    alog::get_mdata()->retention_.set(max_files, max_bytes, max_age_sec);
+}
+
+AA_API void alog_setcompress(int level, std::uint32_t cpu_percent)
+{
+    alog::get_mdata()->retention_.setcompress(level, cpu_percent);
+}
+
+AA_API void alog_setmmap(std::uint64_t chunk_bytes)
+{
+    // 映射偏移需按页对齐，块大小取64KB的整数倍
+    constexpr std::uint64_t align = 64 * 1024;
+    alog::get_mdata()->mmap_chunk_ = chunk_bytes ? (chunk_bytes + align - 1) / align * align : 0;
+}
+
+AA_API void alog_setlive(std::uint64_t bytes)
+{
+    alog::get_mdata()->live_bytes_ = bytes;
+}
+
+AA_API void alog_setcrashdump(bool v)
+{
+    alog::get_mdata()->crash_dump_ = v;
+}
+
+AA_API void alog_setkvformat(int format)
+{
+    alog::get_mdata()->kv_format_ = format == alog::KV_LOGFMT ? alog::KV_LOGFMT : alog::KV_JSON;
+}
+
+AA_API int alog_get_kvformat()
+{
+    return alog::get_mdata()->kv_format_.load(std::memory_order_relaxed);
+}
+
+AA_API void alog_setsplitlevel(bool v)
+{
+    alog::get_mdata()->split_level_ = v;
+}
+
+AA_API void alog_setring(std::uint64_t bytes, int policy)
+{
+    auto md = alog::get_mdata();
+    if (bytes)
+    {
+        md->ring_size_ = bytes;
+    }
+    if (policy < alog::RING_BLOCK || policy > alog::RING_SPILL)
+    {
+        policy = alog::RING_SPILL;
+    }
+    md->ring_policy_ = policy;
+}
 
-    // if (!md->is_settings_)
-    // {
-    //     std::cout << txt_addr << std::endl;
-    // }
+AA_API void alog_getdrops(void (*fn)(void* ud, std::uint64_t tid, std::uint64_t count), void* ud)
+{
+    auto md = alog::get_mdata();
+    std::lock_guard<std::mutex> lk(md->ring_mtx_);
+    for (auto r : md->rings_)
+    {
+        fn(ud, r->tid_, r->drop_count_);
+    }
+    fn(ud, 0, md->exited_drop_count_);
 }
@@ -0,0 +1,352 @@
+#include "ahcpp.h"
+
+#ifndef _WIN32
+
+#include <cstring>
+#include <ctime>
+
+#include <execinfo.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "a.log.h"
+#include "a.thread.h"
+
+// 崩溃转储：在出错线程的信号处理函数中运行，只用异步信号安全的调用（open/write/clock_gettime/nanosleep），
+//    不分配内存、不加锁；读取其它线程的数据不加锁，按界限检查尽力而为
+
+namespace alog
+{
+    namespace
+    {
+        constexpr const char* level_tags[4] = {"INF", "DBG", "WAR", "ERR"};
+        constexpr std::size_t max_items = 100000;      // 每个链表最多转储的记录数（防止链表损坏成环）
+        constexpr int drain_wait_ms = 1000;            // 等日志线程写出排队日志的最长时间
+
+        const char* signal_name(int sig)
+        {
+            switch (sig)
+            {
+            case SIGSEGV:
+                return "SIGSEGV";
+            case SIGBUS:
+                return "SIGBUS";
+            case SIGFPE:
+                return "SIGFPE";
+            case SIGILL:
+                return "SIGILL";
+            case SIGABRT:
+                return "SIGABRT";
+            default:
+                return "?";
+            }
+        }
+
+        std::uint64_t now_ms()
+        {
+            timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            return (std::uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+        }
+
+        void sleep_ms(int ms)
+        {
+            timespec ts{ms / 1000, (long)(ms % 1000) * 1000000};
+            nanosleep(&ts, nullptr);
+        }
+
+        // 出错指令地址
+        std::uint64_t fault_pc(void* ucontext)
+        {
+            auto uc = static_cast<ucontext_t*>(ucontext);
+            if (!uc)
+            {
+                return 0;
+            }
+        #if defined(__x86_64__)
+            return (std::uint64_t)uc->uc_mcontext.gregs[REG_RIP];
+        #elif defined(__aarch64__)
+            return (std::uint64_t)uc->uc_mcontext.pc;
+        #else
+            return 0;
+        #endif
+        }
+
+        // 不加锁读取std::string，长度越界时截断
+        void put_name(crash_out& out, const std::string& s)
+        {
+            auto size = s.size();
+            out.put(s.data(), size < 64 ? size : 64);
+        }
+
+        void put_list(crash_out& out, const log_item* item)
+        {
+            for (std::size_t i = 0; item && i < max_items; ++i, item = item->next)
+            {
+                dump_item(out, item);
+            }
+        }
+
+        void copy_file(crash_out& out, const char* path)
+        {
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                return;
+            }
+            out.flush();
+            char block[4096];
+            ssize_t n;
+            while ((n = ::read(fd, block, sizeof(block))) > 0)
+            {
+                out.put(block, (std::size_t)n);
+            }
+            ::close(fd);
+        }
+
+        void dump_threads(crash_out& out, std::uint64_t crash_tid)
+        {
+            auto md = athd::get_mdata();
+            out.put("---- threads (tid name job) ----\n");
+            for (auto& [tid, t] : md->thread_map_)
+            {
+                if (!t)
+                {
+                    continue;
+                }
+                out.put(tid == crash_tid ? "* " : "  ");
+                out.put_uint(tid);
+                out.put(" ");
+                put_name(out, t->thread_name_);
+                out.put(" ");
+                put_name(out, t->curr_job_name_);
+                out.put("\n");
+            }
+        }
+
+        void dump_pending(crash_out& out, mdata* md)
+        {
+            out.put("---- pending logs (not written by the log thread) ----\n");
+            // rings_在加锁时增删，这里只按当前长度读取
+            auto size = md->rings_.size();
+            auto rings = md->rings_.data();
+            for (std::size_t i = 0; rings && i < size; ++i)
+            {
+                if (rings[i])
+                {
+                    rings[i]->crash_dump(out);
+                }
+            }
+            put_list(out, const_cast<const log_item*>(md->head_));
+        }
+    }
+
+    void crash_out::put(const char* p, std::size_t size)
+    {
+        while (size)
+        {
+            if (len_ == sizeof(buf_))
+            {
+                flush();
+            }
+            auto n = sizeof(buf_) - len_ < size ? sizeof(buf_) - len_ : size;
+            std::memcpy(buf_ + len_, p, n);
+            len_ += n;
+            p += n;
+            size -= n;
+        }
+    }
+
+    void crash_out::put(const char* s)
+    {
+        put(s, std::strlen(s));
+    }
+
+    void crash_out::put_uint(std::uint64_t v, int base)
+    {
+        char tmp[24];
+        int i = sizeof(tmp);
+        do
+        {
+            auto d = (int)(v % base);
+            tmp[--i] = (char)(d < 10 ? '0' + d : 'a' + d - 10);
+            v /= base;
+        } while (v);
+        if (base == 16)
+        {
+            put("0x", 2);
+        }
+        put(tmp + i, sizeof(tmp) - i);
+    }
+
+    void crash_out::flush()
+    {
+        std::size_t off = 0;
+        while (fd_ >= 0 && off < len_)
+        {
+            auto n = ::write(fd_, buf_ + off, len_ - off);
+            if (n <= 0)
+            {
+                break;
+            }
+            off += (std::size_t)n;
+        }
+        len_ = 0;
+    }
+
+    void dump_item(crash_out& out, const log_item* item)
+    {
+        auto level = (unsigned)item->level < 4 ? level_tags[item->level] : "???";
+        auto file = static_cast<const log_file*>(item->file);
+        out.put("[");
+        out.put_uint(item->tid);
+        out.put("] [");
+        if (file)
+        {
+            put_name(out, file->file_name_upper_);
+        }
+        else
+        {
+            out.put("SYS");
+        }
+        out.put("-");
+        out.put(level);
+        out.put("] [");
+        out.put_uint(item->time);
+        out.put("] >> ");
+        if (item->size < 0 || item->size > 1024 * 1024)
+        {
+            out.put("<bad record>\n");
+            return;
+        }
+        if (item->is_binary)
+        {
+            // 二进制记录只输出格式串（格式化需要分配内存）
+            pvt::bin_head head;
+            std::memcpy(&head, item->context, sizeof(head));
+            out.put("<binary> ");
+            if (head.fmt_ && head.fmt_size_ < 4096)
+            {
+                out.put(head.fmt_, head.fmt_size_);
+            }
+            out.put("\n");
+            return;
+        }
+        out.put(item->context, (std::size_t)item->size);
+    }
+
+    void log_ring::crash_dump(crash_out& out) const
+    {
+        auto pos = read_pos_.load(std::memory_order_acquire);
+        auto end = write_pos_.load(std::memory_order_acquire);
+        for (std::size_t i = 0; pos < end && end - pos <= cap_ && i < max_items; ++i)
+        {
+            auto rec = reinterpret_cast<const ring_rec*>(buf_ + (pos & mask_));
+            if (rec->size < sizeof(ring_rec) || rec->size > cap_)
+            {
+                break;
+            }
+            if (!rec->is_pad)
+            {
+                dump_item(out, reinterpret_cast<const log_item*>(rec + 1));
+            }
+            pos += rec->size;
+        }
+        put_list(out, spill_head_);
+    }
+
+    void crash_dump(int sig, void* info, void* ucontext)
+    {
+        auto md = get_mdata();
+        if (!md->crash_dump_.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        auto tid = (std::uint64_t)syscall(SYS_gettid);
+        auto now = now_ms();
+
+        // 崩溃文件：<日志目录>/crash_<服务标志>_<毫秒>_<pid>.log，未setroot时写到stderr
+        crash_out out;
+        if (md->crash_path_[0])
+        {
+            char path[sizeof(md->crash_path_) + 64];
+            crash_out name;
+            name.put(md->crash_path_);
+            name.put("_");
+            name.put_uint(now);
+            name.put("_");
+            name.put_uint((std::uint64_t)getpid());
+            name.put(".log");
+            auto n = name.len_ < sizeof(path) - 1 ? name.len_ : sizeof(path) - 1;
+            std::memcpy(path, name.buf_, n);
+            path[n] = 0;
+            out.fd_ = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+        if (out.fd_ < 0)
+        {
+            out.fd_ = STDERR_FILENO;
+        }
+
+        auto si = static_cast<siginfo_t*>(info);
+        out.put("==== crash ====\nsignal: ");
+        out.put_uint((std::uint64_t)sig);
+        out.put(" (");
+        out.put(signal_name(sig));
+        out.put(") code: ");
+        out.put_uint(si ? (std::uint64_t)(unsigned)si->si_code : 0);
+        out.put(" addr: ");
+        out.put_uint(si ? (std::uint64_t)si->si_addr : 0, 16);
+        out.put(" pc: ");
+        out.put_uint(fault_pc(ucontext), 16);
+        out.put("\npid: ");
+        out.put_uint((std::uint64_t)getpid());
+        out.put(" tid: ");
+        out.put_uint(tid);
+        out.put(" time: ");
+        out.put_uint(now);
+        out.put("\n");
+
+        // 原始调用栈（地址，可按下方maps离线解析），再附backtrace_symbols_fd的符号（不分配内存）
+        void* frames[64];
+        int frame_count = backtrace(frames, 64);
+        out.put("---- backtrace ----\n");
+        for (int i = 0; i < frame_count; ++i)
+        {
+            out.put_uint((std::uint64_t)frames[i], 16);
+            out.put("\n");
+        }
+        out.flush();
+        backtrace_symbols_fd(frames, frame_count, out.fd_);
+
+        dump_threads(out, tid);
+        out.flush();
+
+        // 日志线程仍在运行：给它时间把排队的日志写进各自的文件，剩下的再转储
+        auto log_tid = md->log_tid_.load(std::memory_order_relaxed);
+        if (log_tid != tid && md->is_settings_.load(std::memory_order_relaxed))
+        {
+            for (int waited = 0; waited < drain_wait_ms && md->queued_count_.load(std::memory_order_relaxed); waited += 10)
+            {
+                sleep_ms(10);
+            }
+            sleep_ms(20);  // 最后一批的写入
+        }
+        dump_pending(out, md);
+
+        out.put("---- maps ----\n");
+        copy_file(out, "/proc/self/maps");
+        out.put("==== end ====\n");
+        out.flush();
+        if (out.fd_ != STDERR_FILENO)
+        {
+            ::fsync(out.fd_);
+            ::close(out.fd_);
+        }
+    }
+}
+
+#endif
@@ -1,14 +1,21 @@
 #pragma once
 
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <array>
 #include <cstring>
 #include <cstdio>
 #include <string>
 #include <tuple>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 #include <condition_variable>
 
 #include "alog.h"
+#include "alogshm.h"
 
 namespace alog
 {
@@ -19,46 +26,276 @@ namespace alog
         std::uint64_t tid;
         void* file;                     // 日志标志
         LogLevel level;                 // 日志等级
+        bool is_binary;                 // 内容为二进制记录（见alog::pvt::bin_head），写出前格式化
+        std::uint16_t frame_count;      // 原始调用栈帧数，帧地址紧跟在内容结尾0之后，由日志线程解析
         uint64_t time;                  // 日志时间
+        uint64_t seq;                   // 线程内序号，同一毫秒内保序
         int size;                       // 内容大小
         char context[0];                // 日志内容
     };
 
-    class log_file
+    // 进程内符号解析（Linux，见a.log.symbol.cpp）：把一个运行时地址格式化为一行帧文本追加到buf，返回新的写入位置
+    std::size_t symbolize_to_buf(char* buf, std::size_t buf_size, std::size_t offset, std::uint64_t addr);
+
+    // 崩溃转储输出：只用write(2)和栈上缓冲，可在信号处理函数中使用（见a.log.crash.cpp）
+    struct crash_out
     {
+        int fd_ = -1;
+        std::size_t len_ = 0;
+        char buf_[4096];
+
+        void put(const char* p, std::size_t size);
+        void put(const char* s);
+        void put_uint(std::uint64_t v, int base = 10);
+        void flush();
+    };
+
+    // 致命信号时把崩溃线程调用栈、各线程当前作业和未写出的日志写入崩溃文件（asig::set_crash_handler）
+    void crash_dump(int sig, void* info, void* ucontext);
+    void dump_item(crash_out& out, const log_item* item);
+
+    // 单生产者单消费者字节环：每个写日志线程一个，记录为变长log_item
+    //    记录格式：[ring_rec][log_item][内容]，按8字节对齐，尾部不够时写填充记录回绕
+    struct ring_rec
+    {
+        std::uint32_t size;             // 记录总字节数（含本头）
+        std::uint32_t is_pad;           // 1：回绕填充
+    };
+
+    class log_ring
+    {
+    public:
+        log_ring(std::size_t capacity, std::uint64_t tid);
+        ~log_ring();
+        log_ring(const log_ring&) = delete;
+        log_ring& operator=(const log_ring&) = delete;
+
+        // 生产者：预留bytes字节（log_item+内容），空间不足返回nullptr
+        log_item* reserve(std::size_t bytes);
+        void commit();
+
+        // 生产者：环满或记录过大时转入本环的溢出链表，溢出未被取走前后续日志也进溢出链表（保序）
+        void push_spill(log_item* item);
+        inline bool is_spilling() const
+        {
+            return spilling_.load(std::memory_order_acquire);
+        }
+
+        // 消费者：snapshot固定本批可读范围（环内记录在前，溢出链表在后），返回本批记录数
+        std::uint64_t snapshot();
+        log_item* peek();
+        void pop();
+        bool has_data() const;
+        // 崩溃转储：已提交、日志线程尚未取走的记录（不加锁，尽力而为）
+        void crash_dump(crash_out& out) const;
+
+        inline std::size_t max_record() const
+        {
+            return cap_ / 2;
+        }
+
     public:
+        std::uint64_t tid_;
+        std::atomic_uint64_t drop_count_{0};
+        std::atomic_bool closed_{false};    // 所属线程已退出
+
+    private:
+        char* buf_;
+        std::size_t cap_;
+        std::size_t mask_;
+
+        alignas(64) std::atomic_uint64_t write_pos_{0};
+        std::atomic_uint64_t write_count_{0};
+        std::uint64_t reserve_end_ = 0;     // 生产者私有
+        std::uint64_t cached_read_ = 0;     // 生产者私有
+
+        alignas(64) std::atomic_uint64_t read_pos_{0};
+        std::uint64_t read_count_ = 0;      // 消费者私有
+        std::uint64_t limit_pos_ = 0;       // 消费者私有：本批可读上限
+        log_item* spill_batch_ = nullptr;   // 消费者私有：本批溢出记录
+
+        std::mutex spill_mtx_;
+        std::atomic_bool spilling_{false};
+        log_item* spill_head_ = nullptr;
+        log_item* spill_tail_ = nullptr;
+    };
+
+    // 一个打开的日志文件及其批缓冲
+    struct log_sink
+    {
+        std::FILE* fp_ = nullptr;
         int hour_ = -1;
-        LogLevel last_level_ = (LogLevel)-1;
+        int part_ = 0;                      // 同一小时内按大小切分的分片号
+        std::uint64_t file_bytes_ = 0;      // 当前文件字节数（含打开前已有的）
+        std::string full_filename_;
+
+        std::string wbuf_;                  // 本批待写内容，批结束时一次写入
+        std::size_t unsynced_bytes_ = 0;    // 已写入但未fsync的字节数
+        std::uint64_t last_sync_ms_ = 0;
+        std::unordered_set<std::uint64_t> traced_;  // 本文件已输出过的调用栈编号，换文件时清空
+        bool has_error_ = false;            // 本批含ERROR日志
+        bool is_dirty_ = false;             // 已在mdata::dirty_sinks_中
+
+        // 内存映射写（见alog_setmmap）：文件按块预分配并映射，记录直接拷贝进映射区，
+        //    进程崩溃时已拷贝的内容在页缓存中，由内核回写
+        std::uint64_t map_chunk_ = 0;       // 映射块大小，0：stdio写
+        char* map_ = nullptr;
+        std::uint64_t map_off_ = 0;         // 当前映射块在文件中的偏移
+        std::size_t map_size_ = 0;
+        std::uint64_t tail_ = 0;            // 有效内容结尾，其后为预分配的0
+
+        void put(const char* p, std::size_t size);
+        void open_map(std::uint64_t chunk_bytes);
+        bool map_next();
+        void flush();
+        void sync(std::uint64_t now_ms);
+        bool need_sync(int mode, std::uint64_t now_ms, std::uint64_t sync_ms, std::size_t sync_bytes);
+        void close();
+    };
+
+    // 本地时间拆分：时区偏移每15分钟计算一次，日期由天数直接换算（不逐行调用localtime）
+    struct civil_time
+    {
+        int year;
+        int mon;
+        int day;
+        int hour;
+        int min;
+        int sec;
+    };
+
+    class log_clock
+    {
+    public:
+        bool split(std::uint64_t time_sec, civil_time& out);    // 返回是否重算了时区偏移
 
+    private:
+        std::int64_t tz_offset_ = 0;
+        std::uint64_t valid_begin_ = 1;     // 偏移有效的UTC秒区间[begin, end)
+        std::uint64_t valid_end_ = 0;
+    };
+
+    class log_file
+    {
+    public:
         std::string file_name_;
         std::string file_name_upper_;
-        std::string full_filename_;
-        std::FILE* fp_ = nullptr;
         bool is_sys_ = false;
+
+        // 行头缓存：同一秒、同一线程、同一等级只改毫秒和未决数
+        std::uint64_t hdr_sec_ = UINT64_MAX;
+        std::uint64_t hdr_tid_ = 0;
+        int hdr_level_ = -1;
+        int hdr_hour_ = -1;
+        std::size_t hdr_len_ = 0;
+        std::size_t hdr_ms_pos_ = 0;
+        char hdr_[256];
+
+        // 每个等级一个文件句柄，不再因等级交替而反复关闭/打开；
+        // 不分等级（alog_setsplitlevel(false)）时共用sinks_[0]
+        std::array<log_sink, 4> sinks_;
     public:
         log_file(const std::string& file_name);
         ~log_file();
-        void rotate_file(struct tm* tm_info, int level, const std::string log_dir, const std::string& process_flag_file_name);        
+        void rotate_file(log_sink& sink, time_t time_sec, int hour, int part, const char* level_name, const std::string log_dir, const std::string& process_flag_file_name);        
+        std::size_t make_header(log_item* item, int pending_count, char* out);
         void write(log_item* item, int pending_count, bool out_screen, bool print_sys_to_screen, 
             const std::string log_dir, const std::string& process_flag_file_name);
     };
 
+    // 日志保留：后台低优先级线程压缩换出的文件（gzip+索引）并按策略删除旧文件，首次设置策略时创建；
+    //    日志线程换文件时只登记正在写的文件并通知，不做任何压缩和删除
+    class log_retention
+    {
+    public:
+        ~log_retention();
+        void set(std::uint32_t max_files, std::uint64_t max_bytes, std::uint64_t max_age_sec);
+        void setcompress(int level, std::uint32_t cpu_percent);
+        void setdir(const std::string& dir, const std::string& process_flag_file_name);
+        void rotated(const std::string& closed_file, const std::string& opened_file);
+
+    private:
+        void start();
+        void run();
+        void sweep();
+        bool compress(const std::string& file, int level, std::uint32_t cpu_percent);
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::thread thread_;
+        bool is_stop_ = false;
+        bool is_dirty_ = false;
+        std::string dir_;
+        std::string file_tag_;                      // "_服务标志_"，只处理本服务的日志文件
+        std::unordered_set<std::string> active_;    // 正在写的文件
+        std::deque<std::string> pending_;           // 待压缩的已换出文件
+        std::uint32_t max_files_ = 0;
+        std::uint64_t max_bytes_ = 0;
+        std::uint64_t max_age_sec_ = 0;
+        int compress_level_ = 0;                    // gzip压缩级别，0不压缩
+        std::uint32_t cpu_percent_ = 20;            // 压缩线程CPU占用上限（单核百分比）
+    };
+
+    // 共享内存实时日志环（布局见alogshm.h）：日志线程把每条记录顺带拷贝一份，外部工具（aalog-tail）只读跟踪，
+    //    不经过屏幕输出、不影响磁盘；仅日志线程写
+    class live_ring
+    {
+    public:
+        ~live_ring();
+        bool open(const std::string& process_flag, const std::string& process_flag_file_name, std::uint64_t capacity);
+        void close();
+        void put(const log_item* item, const log_file* file);
+
+    private:
+        shm::header* hdr_ = nullptr;
+        char* data_ = nullptr;
+        std::uint64_t cap_ = 0;
+        std::size_t map_size_ = 0;
+        std::string name_;
+    };
+
+    // 调用点限流槽（GCRA令牌桶），键为格式串地址或Lua源码行
+    struct site_slot
+    {
+        std::atomic_uint64_t key_{0};       // 0：空槽
+        std::atomic_bool ready_{false};     // desc_/file_/level_已写好
+        void* file_ = nullptr;
+        int level_ = 0;
+        char desc_[120] = {};               // 汇总行文本：格式串或"源文件:行号"
+        std::atomic_uint64_t tid_{0};       // 最近被抑制的线程
+        std::atomic_uint64_t tat_{0};       // 理论到达时间（纳秒）
+        std::atomic_uint64_t suppressed_{0};
+        std::atomic_uint64_t trace_ms_{0};  // 上次取调用栈的时间
+    };
+
     class mdata
     {
     public:
+        // 公共溢出链表：线程退出（环已关闭）后的日志走这里
         volatile log_item* head_ = nullptr;
         log_item* tail_ = nullptr;
         std::atomic_int item_count_ = 0;
         std::mutex mtx_;
         std::condition_variable cv_;
+        std::atomic_bool is_waiting_ = false;  // 日志线程空闲等待中（eventcount）
         std::thread work_thread_;
+
+        // 各线程的日志环
+        std::mutex ring_mtx_;
+        std::vector<log_ring*> rings_;
+        std::vector<log_ring*> sources_;        // 本批参与合并的环，仅日志线程访问
+        std::vector<log_item*> spills_;         // 本批溢出日志（按时间排序），仅日志线程访问
+        std::atomic_uint64_t ring_size_ = 256 * 1024;
+        std::atomic_int ring_policy_ = RING_SPILL;
+        std::atomic_uint64_t drop_count_ = 0;
+        std::atomic_uint64_t exited_drop_count_ = 0;
         
         std::vector<std::shared_ptr<log_file>> log_files_;
         std::string process_flag_;
         std::string process_flag_file_name_;
         std::string root_dir_;
-        int error_count_ = 0;
-        int warning_count_ = 0;
+        std::atomic_int error_count_ = 0;
+        std::atomic_int warning_count_ = 0;
         bool print_debug_ = true;
         bool print_screen_ = false;
         bool print_sys_log_to_screen_ = false;
@@ -66,12 +303,74 @@ namespace alog
         std::atomic_bool is_runing_ = false;
         std::atomic_bool is_settings_ = false;
         std::array<char, 1024*1024> buf_;
+
+        // 落盘策略（见alog::SyncMode）
+        std::atomic_int sync_mode_ = SYNC_INTERVAL;
+        std::atomic_uint64_t sync_ms_ = 1000;
+        std::atomic_uint64_t sync_bytes_ = 1024 * 1024;
+        std::vector<log_sink*> dirty_sinks_;    // 有待写或未落盘内容的文件，仅日志线程访问
+        std::atomic_bool split_level_ = true;   // 各等级分文件
+        log_clock clock_;                       // 仅日志线程访问
+        std::unordered_map<std::uint64_t, std::string> tnames_;    // 线程名缓存，仅日志线程访问
+        std::atomic_bool is_binary_ = false;    // 二进制模式
+        std::vector<char> decode_buf_;          // 二进制记录还原缓冲，仅日志线程访问
+        std::atomic_int kv_format_ = KV_JSON;   // 结构化日志编码格式
+        std::atomic_uint64_t rotate_bytes_ = 0; // 按大小切分阈值，0只按整点切分
+        std::atomic_uint64_t mmap_chunk_ = 0;   // 内存映射写的映射块大小，0：stdio写
+        std::atomic_uint64_t live_bytes_ = 4 * 1024 * 1024;    // 共享内存实时日志环大小，0不开启
+        live_ring live_;                        // setroot时打开，之后仅日志线程访问
+        std::atomic_bool crash_dump_ = true;    // 致命信号时写崩溃文件（见alog_setcrashdump）
+        std::atomic_uint64_t log_tid_ = 0;      // 日志线程id
+        char crash_path_[1024] = {};            // 崩溃文件路径前缀，setroot时生成（信号处理中不能分配内存）
+        log_retention retention_;
+
+        // 调用点限流与重复抑制（见alog_setratelimit）
+        static constexpr std::size_t site_count = 2048;
+        std::array<site_slot, site_count> sites_;
+        std::atomic_uint64_t site_interval_ns_ = 0;     // 0：不限流（默认），须alog_setratelimit开启
+        std::atomic_uint64_t site_tolerance_ns_ = 0;
+        std::atomic_uint64_t trace_window_ms_ = 1000;
+        std::atomic_bool has_suppressed_ = false;
+        std::uint64_t last_sweep_ms_ = 0;       // 仅日志线程访问
+        std::vector<char> summary_buf_;         // 仅日志线程访问
+
+        // 队列预算（见alog_setbudget），字节/条数含各线程环与溢出链表
+        std::atomic_uint64_t queued_bytes_ = 0;
+        std::atomic_uint64_t queued_count_ = 0;
+        std::atomic_uint64_t budget_ = 64 * 1024 * 1024;
+        std::atomic_int overload_policy_ = OVERLOAD_DROP;
+        std::array<std::atomic_uint64_t, 4> overload_drops_ = {};
+        std::array<std::uint64_t, 4> reported_drops_ = {};     // 已汇总的丢弃数，仅日志线程访问
+        std::atomic_bool has_overload_ = false;
+        std::uint64_t last_overload_ms_ = 0;                   // 仅日志线程访问
+
+        // 调用栈去重：栈哈希 -> 编号，同一文件内每个调用栈只完整输出一次，仅日志线程访问
+        std::unordered_map<std::uint64_t, std::uint64_t> stack_ids_;
+        std::uint64_t next_stack_id_ = 0;      // 只增不减：stack_ids_清空后也不复用编号（各文件traced_仍按旧编号记录）
+        std::string trace_buf_;
     public:
         mdata();
         ~mdata();
         inline void stop();
         inline std::tuple<log_item*, log_item*, int> get_items();
-        inline void process_item(log_item* item);
+        inline void process_item(log_item* item, int pending_count);
+        log_item* decode_item(log_item* item);
+        site_slot* find_site(std::uint64_t key, void* file, int level, const char* desc, std::size_t desc_size);
+        int admit(void* file, int level, std::uint64_t key, const char* desc, std::size_t desc_size);
+        inline void report_suppressed(bool is_final);
+        inline void report_overload(bool is_final);
+        log_item* synthetic_item(void* file, int level, std::uint64_t tid, std::uint64_t now);
+        inline void write_synthetic(log_item* item, pvt::writer& w);
+        bool admit_bytes(int level, std::size_t bytes);
+        const std::string& trace_text(log_item* item, log_sink& sink);
         inline void process_logs();
+        inline void commit_files(bool is_final);
+        inline bool rings_ready();
+        inline void merge_items(log_item* spill, int spill_count);
+        inline void free_closed_rings();
+        log_ring* new_ring();
+        void wake();
     };
+
+    mdata* get_mdata();
 }
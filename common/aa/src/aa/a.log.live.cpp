@@ -0,0 +1,145 @@
+#include "ahcpp.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "a.log.h"
+
+// 共享内存实时日志环：每条记录只多一次memcpy和两次原子写，读端在另一个进程，写端从不等待读端
+
+namespace alog
+{
+    namespace
+    {
+        constexpr std::size_t max_text = 4096;     // 单条记录最多拷贝的内容字节，超出截断
+    }
+
+    live_ring::~live_ring()
+    {
+        close();
+    }
+
+    bool live_ring::open(const std::string& process_flag, const std::string& process_flag_file_name, std::uint64_t capacity)
+    {
+    #ifndef _WIN32
+        if (hdr_ || !capacity)
+        {
+            return hdr_ != nullptr;
+        }
+        std::uint64_t cap = 64 * 1024;
+        while (cap < capacity)
+        {
+            cap <<= 1;
+        }
+
+        // 对象名只能有开头一个'/'
+        name_ = std::string(shm::name_prefix) + process_flag_file_name;
+        std::replace(name_.begin() + 1, name_.end(), '/', '-');
+
+        int fd = ::shm_open(name_.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            std::cout << "实时日志共享内存创建失败：" << name_ << std::endl;
+            return false;
+        }
+        map_size_ = sizeof(shm::header) + cap;
+        void* addr = MAP_FAILED;
+        if (::ftruncate(fd, (off_t)map_size_) == 0)
+        {
+            addr = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (addr == MAP_FAILED)
+        {
+            std::cout << "实时日志共享内存映射失败：" << name_ << std::endl;
+            ::shm_unlink(name_.c_str());
+            return false;
+        }
+
+        // 上次进程留下的对象直接重置，magic_最后写，读端看到magic_才开始读
+        auto hdr = static_cast<shm::header*>(addr);
+        std::memset(addr, 0, sizeof(shm::header));
+        hdr->version_ = shm::version;
+        hdr->capacity_ = cap;
+        hdr->pid_ = (std::uint64_t)::getpid();
+        std::strncpy(hdr->process_flag_, process_flag.c_str(), sizeof(hdr->process_flag_) - 1);
+        std::atomic_thread_fence(std::memory_order_release);
+        hdr->magic_ = shm::magic;
+
+        data_ = static_cast<char*>(addr) + sizeof(shm::header);
+        cap_ = cap;
+        hdr_ = hdr;
+        return true;
+    #else
+        return false;
+    #endif
+    }
+
+    void live_ring::close()
+    {
+    #ifndef _WIN32
+        if (!hdr_)
+        {
+            return;
+        }
+        ::munmap(hdr_, map_size_);
+        ::shm_unlink(name_.c_str());
+        hdr_ = nullptr;
+        data_ = nullptr;
+    #endif
+    }
+
+    void live_ring::put(const log_item* item, const log_file* file)
+    {
+        if (!hdr_)
+        {
+            return;
+        }
+        auto text_size = std::min<std::size_t>(item->size, max_text);
+        auto size = shm::record_size(text_size);
+        auto mask = cap_ - 1;
+        auto pos = hdr_->write_pos_.load(std::memory_order_relaxed);
+        auto tail_room = cap_ - (pos & mask);
+        auto need = size <= tail_room ? size : tail_room + size;
+
+        // 顺序锁：先标记正在写并推进tail_pos_，再覆盖数据（读端据tail_pos_判断拷贝是否被覆盖）
+        auto seq = hdr_->seq_.load(std::memory_order_relaxed);
+        hdr_->seq_.store(seq + 1, std::memory_order_relaxed);
+        auto tail = hdr_->tail_pos_.load(std::memory_order_relaxed);
+        while (pos + need - tail > cap_)
+        {
+            tail += reinterpret_cast<const shm::record*>(data_ + (tail & mask))->size_;
+        }
+        hdr_->tail_pos_.store(tail, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (size > tail_room)
+        {
+            auto pad = reinterpret_cast<shm::record*>(data_ + (pos & mask));
+            pad->size_ = (std::uint32_t)tail_room;
+            pad->is_pad_ = 1;
+            pos += tail_room;
+        }
+        auto rec = reinterpret_cast<shm::record*>(data_ + (pos & mask));
+        rec->size_ = (std::uint32_t)size;
+        rec->is_pad_ = 0;
+        rec->level_ = (std::uint8_t)item->level;
+        rec->text_size_ = (std::uint16_t)text_size;
+        rec->tid_ = item->tid;
+        rec->time_ = item->time;
+        std::memset(rec->logger_, 0, sizeof(rec->logger_));
+        std::memcpy(rec->logger_, file->file_name_upper_.data(), std::min(file->file_name_upper_.size(), sizeof(rec->logger_) - 1));
+        std::memcpy(rec->text_, item->context, text_size);
+
+        hdr_->write_pos_.store(pos + size, std::memory_order_relaxed);
+        hdr_->count_.store(hdr_->count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        hdr_->seq_.store(seq + 2, std::memory_order_release);
+    }
+}
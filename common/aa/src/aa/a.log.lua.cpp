@@ -4,18 +4,58 @@
 
 #include <lua.hpp>
 #include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include "alua.h"
 #include "alog.h"
+#include "athd.h"
 
 namespace
 {
     static auto lua_log_file = alog::addfile("lua");
 
+    // 调用点：Lua源码行（跳过alog.lua自身的封装层），键为"源文件:行号"的哈希
+    std::uint64_t site_key(lua_State* L, char* desc, std::size_t desc_size, std::size_t& desc_len)
+    {
+        lua_Debug ar;
+        desc_len = 0;
+        for (int level = 1; level <= 2; ++level)
+        {
+            if (!lua_getstack(L, level, &ar) || !lua_getinfo(L, "Sl", &ar))
+            {
+                return 0;
+            }
+            std::string_view src = ar.short_src;
+            if (level == 1 && src.size() >= 8 && src.substr(src.size() - 8) == "alog.lua")
+            {
+                continue;
+            }
+            auto n = std::snprintf(desc, desc_size, "%s:%d", ar.short_src, ar.currentline);
+            desc_len = std::min<std::size_t>(n > 0 ? n : 0, desc_size - 1);
+            std::uint64_t h = 14695981039346656037ull;
+            for (std::size_t i = 0; i < desc_len; ++i)
+            {
+                h = (h ^ (unsigned char)desc[i]) * 1099511628211ull;
+            }
+            return h | 1;
+        }
+        return 0;
+    }
+
     void lua_print(lua_State* L, int level)
     {
         constexpr std::size_t kMaxLog = 4096;            // 可调
         static thread_local char g_buff[kMaxLog];
 
+        char desc[128];
+        std::size_t desc_len;
+        auto key = site_key(L, desc, sizeof(desc), desc_len);
+        if (!(alog_admit(lua_log_file, level, key, desc, desc_len) & alog::ADMIT_PASS))
+        {
+            return;
+        }
+
         char* p   = g_buff;
         char* end = g_buff + kMaxLog - 16;           // 预留 "<truncated>" 空间
         int top   = lua_gettop(L);
@@ -86,6 +126,120 @@ namespace
         alog_print(lua_log_file, level, g_buff, final_len);
     }
 
+    // 结构化日志：alog.kv(level, event, {k = v, ...})，字段按表遍历顺序编码，仅取字符串键
+    //    与C++侧alog::kv共用编码器，调用点按事件名限流
+    static int lua_api_kv(lua_State* L)
+    {
+        auto level = static_cast<alog::LogLevel>(luaL_checkinteger(L, 1));
+        std::size_t event_len;
+        const char* event_str = luaL_checklstring(L, 2, &event_len);
+        std::string_view event(event_str, event_len);
+        if (level < alog::LEVEL_INFO || level > alog::LEVEL_ERROR)
+        {
+            return luaL_argerror(L, 1, "invalid level");
+        }
+        if (level == alog::LEVEL_DEBUG && !alog_is_print_debug())
+        {
+            return 0;
+        }
+        int flags = alog_admit(lua_log_file, level, alog::pvt::kv_key(event), event.data(), event.size());
+        if (!(flags & alog::ADMIT_PASS))
+        {
+            return 0;
+        }
+
+        char* buf_addr;
+        std::size_t buf_size;
+        alog_get_buf(&buf_addr, &buf_size);
+
+        int format = alog_get_kvformat();
+        alog::pvt::writer w(buf_addr, buf_size - 1);
+        alog::pvt::put_kv_begin(w, format, event);
+        if (lua_istable(L, 3))
+        {
+            char tmp[64];
+            lua_pushnil(L);
+            while (lua_next(L, 3))
+            {
+                if (lua_type(L, -2) != LUA_TSTRING)
+                {
+                    lua_pop(L, 1);
+                    continue;
+                }
+                std::size_t key_len;
+                const char* key = lua_tolstring(L, -2, &key_len);
+                alog::field f;
+                switch (lua_type(L, -1))
+                {
+                case LUA_TNUMBER:
+                    f = lua_isinteger(L, -1)
+                        ? alog::field({key, key_len}, static_cast<std::int64_t>(lua_tointeger(L, -1)))
+                        : alog::field({key, key_len}, static_cast<double>(lua_tonumber(L, -1)));
+                    break;
+                case LUA_TSTRING:
+                {
+                    std::size_t len;
+                    const char* v = lua_tolstring(L, -1, &len);
+                    f = alog::field({key, key_len}, std::string_view(v, len));
+                    break;
+                }
+                case LUA_TBOOLEAN:
+                    f = alog::field({key, key_len}, static_cast<bool>(lua_toboolean(L, -1)));
+                    break;
+                default:
+                {
+                    auto n = std::snprintf(tmp, sizeof(tmp), "%s:%p", luaL_typename(L, -1), lua_topointer(L, -1));
+                    f = alog::field({key, key_len}, std::string_view(tmp, std::min<std::size_t>(n > 0 ? n : 0, sizeof(tmp) - 1)));
+                    break;
+                }
+                }
+                alog::pvt::put_kv_field(w, format, f);
+                lua_pop(L, 1);
+            }
+        }
+        alog::pvt::put_kv_end(w, format);
+        std::size_t txt_size = w.ptr() - buf_addr;
+        buf_addr[txt_size] = 0;
+        alog::pvt::submit(lua_log_file, level, buf_addr, txt_size, flags & alog::ADMIT_TRACE);
+        return 0;
+    }
+
+    // 各线程环满丢弃的日志数：{"线程名:tid" = 数量, exited = 已退出线程合计, total = 总数}
+    std::unordered_map<std::string, std::uint64_t> get_drops()
+    {
+        std::unordered_map<std::string, std::uint64_t> ret;
+        alog_getdrops(
+            [](void* ud, std::uint64_t tid, std::uint64_t count)
+            {
+                auto& m = *static_cast<std::unordered_map<std::string, std::uint64_t>*>(ud);
+                m["total"] += count;
+                if (!tid)
+                {
+                    m["exited"] = count;
+                    return;
+                }
+                auto name = athd::gettname(tid);
+                m[std::string(name ? name : "") + ":" + std::to_string(tid)] = count;
+            },
+            &ret);
+        return ret;
+    }
+
+    // 日志队列：{count=排队条数, bytes=排队字节, budget=预算, drop_info/drop_debug/drop_warning=超预算丢弃数}
+    std::unordered_map<std::string, std::uint64_t> get_queue()
+    {
+        alog::queue_stats st;
+        alog_getqueue(&st);
+        return {
+            {"count", st.count_},
+            {"bytes", st.bytes_},
+            {"budget", st.budget_},
+            {"drop_info", st.drop_info_},
+            {"drop_debug", st.drop_debug_},
+            {"drop_warning", st.drop_warning_}
+        };
+    }
+
     static int lua_api_info(lua_State* L)
     {
         lua_print(L, alog::LogLevel::LEVEL_INFO);
@@ -118,12 +272,28 @@ namespace
                 {"debug", lua_api_debug},
                 {"warning", lua_api_warning},
                 {"error", lua_api_error},
+                {"kv", lua_api_kv},
+                {"setkvformat", alua::tocfunc<alog_setkvformat>()},
                 {"setroot", alua::tocfunc<alog_setroot>()},
                 {"setoutdebug", alua::tocfunc<alog_setoutdebug>()},
                 {"print_screen", alua::tocfunc<alog_print_screen>()},
                 {"print_syslog", alua::tocfunc<alog_set_print_sys_log_to_screen>()},
                 {"print_stack", alua::tocfunc<alog_print_stack>()},
                 {"addfile", alua::tocfunc<alog_addfile>()},
+                {"setsync", alua::tocfunc<alog_setsync>()},
+                {"setsplitlevel", alua::tocfunc<alog_setsplitlevel>()},
+                {"setring", alua::tocfunc<alog_setring>()},
+                {"setbinary", alua::tocfunc<alog_setbinary>()},
+                {"setratelimit", alua::tocfunc<alog_setratelimit>()},
+                {"setbudget", alua::tocfunc<alog_setbudget>()},
+                {"setrotate", alua::tocfunc<alog_setrotate>()},
+                {"setretention", alua::tocfunc<alog_setretention>()},
+                {"setcompress", alua::tocfunc<alog_setcompress>()},
+                {"setmmap", alua::tocfunc<alog_setmmap>()},
+                {"setcrashdump", alua::tocfunc<alog_setcrashdump>()},
+                {"setlive", alua::tocfunc<alog_setlive>()},
+                {"getqueue", alua::tocfunc<get_queue>()},
+                {"getdrops", alua::tocfunc<get_drops>()},
                 {NULL, NULL}
             };
 
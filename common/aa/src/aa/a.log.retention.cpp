@@ -0,0 +1,475 @@
+#include "ahcpp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "a.log.h"
+
+// 日志保留：换出的文件压缩为gzip，按文件数/总字节/存在时长删除旧日志文件；压缩耗CPU、删除可能因文件系统
+//    （如ext4删大文件）耗时较长，都放在独立的低优先级线程，日志线程换文件时只登记并通知
+//
+// 压缩格式：多成员gzip（每个成员约1MB原文、在行尾切分，可独立解压），zcat/zgrep可直接读取；
+//    索引文件（.log.gz.idx）每个成员一行："原文偏移 压缩偏移 首行时间"，按时间定位时从对应成员开始解压
+
+namespace alog
+{
+    namespace
+    {
+        // 无新的换文件通知时，按存在时长清理的检查周期
+        constexpr auto sweep_interval = std::chrono::seconds(60);
+
+        // 调度与IO都降到空闲级，只用剩余的CPU和磁盘带宽
+        void lower_priority()
+        {
+        #ifndef _WIN32
+            sigset_t full;
+            sigfillset(&full);
+            for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL})
+            {
+                sigdelset(&full, sig);
+            }
+            pthread_sigmask(SIG_BLOCK, &full, nullptr);
+
+            sched_param sp{};
+            if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp) != 0)
+            {
+                setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+            }
+        #ifdef SYS_ioprio_set
+            constexpr int ioprio_who_process = 1;
+            constexpr int ioprio_class_idle = 3;
+            syscall(SYS_ioprio_set, ioprio_who_process, 0, ioprio_class_idle << 13);
+        #endif
+        #endif
+        }
+
+        constexpr std::size_t chunk_bytes = 64 * 1024;
+        constexpr std::uint64_t member_bytes = 1024 * 1024;
+
+        // 行头"[NN] [YYYY-MM-DD HH:MM:SS.mmm] ..."中的时间，非行头（如调用栈续行）返回"-"
+        std::string_view line_time(const char* p, std::size_t size)
+        {
+            std::string_view line(p, std::min<std::size_t>(size, 48));
+            auto pos = line.find("] [");
+            if (line.empty() || line[0] != '[' || pos == std::string_view::npos || pos + 3 + 23 > line.size())
+            {
+                return "-";
+            }
+            auto t = line.substr(pos + 3, 23);
+            if (t[4] != '-' || t[10] != ' ' || t[19] != '.')
+            {
+                return "-";
+            }
+            return t;
+        }
+
+        bool sync_file(std::FILE* fp)
+        {
+            if (std::fflush(fp) != 0)
+            {
+                return false;
+            }
+        #ifdef _WIN32
+            return ::_commit(_fileno(fp)) == 0;
+        #else
+            return ::fsync(fileno(fp)) == 0;
+        #endif
+        }
+
+        struct old_file
+        {
+            std::filesystem::path path_;
+            std::filesystem::file_time_type mtime_;
+            std::uint64_t size_;
+            bool is_active_;
+        };
+    }
+
+    log_retention::~log_retention()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            is_stop_ = true;
+        }
+        cv_.notify_one();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    // 调用方持有mtx_
+    void log_retention::start()
+    {
+        if (!thread_.joinable())
+        {
+            thread_ = std::thread(&log_retention::run, this);
+            return;
+        }
+        cv_.notify_one();
+    }
+
+    void log_retention::set(std::uint32_t max_files, std::uint64_t max_bytes, std::uint64_t max_age_sec)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        max_files_ = max_files;
+        max_bytes_ = max_bytes;
+        max_age_sec_ = max_age_sec;
+        is_dirty_ = true;
+        if (max_files || max_bytes || max_age_sec)
+        {
+            start();
+        }
+    }
+
+    void log_retention::setcompress(int level, std::uint32_t cpu_percent)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        compress_level_ = std::clamp(level, 0, 9);
+        cpu_percent_ = std::clamp<std::uint32_t>(cpu_percent, 1, 100);
+        if (compress_level_)
+        {
+            start();
+        }
+    }
+
+    void log_retention::setdir(const std::string& dir, const std::string& process_flag_file_name)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        dir_ = dir;
+        file_tag_ = "_" + process_flag_file_name + "_";
+        is_dirty_ = true;
+        cv_.notify_one();
+    }
+
+    // 日志线程调用：只改登记表，不等待清理
+    void log_retention::rotated(const std::string& closed_file, const std::string& opened_file)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (!closed_file.empty())
+        {
+            active_.erase(closed_file);
+            if (compress_level_)
+            {
+                pending_.push_back(closed_file);
+            }
+        }
+        if (!opened_file.empty())
+        {
+            active_.insert(opened_file);
+        }
+        is_dirty_ = true;
+        if (thread_.joinable())
+        {
+            cv_.notify_one();
+        }
+    }
+
+    void log_retention::run()
+    {
+        lower_priority();
+
+        std::unique_lock<std::mutex> lk(mtx_);
+        while (!is_stop_)
+        {
+            cv_.wait_for(lk, sweep_interval, [this] { return is_stop_ || is_dirty_ || !pending_.empty(); });
+            if (is_stop_)
+            {
+                break;
+            }
+            // 先压缩，压缩后的文件再参与保留统计
+            while (!pending_.empty() && compress_level_ && !is_stop_)
+            {
+                auto file = std::move(pending_.front());
+                pending_.pop_front();
+                auto level = compress_level_;
+                auto cpu_percent = cpu_percent_;
+                lk.unlock();
+                compress(file, level, cpu_percent);
+                lk.lock();
+            }
+            if (!compress_level_)
+            {
+                pending_.clear();
+            }
+            is_dirty_ = false;
+            lk.unlock();
+            sweep();
+            lk.lock();
+        }
+    }
+
+    // 压缩到临时文件，落盘后改名，再删除原文件；CPU按占空比限制：每块工作耗时t后休眠t*(100-p)/p
+    bool log_retention::compress(const std::string& file, int level, std::uint32_t cpu_percent)
+    {
+        auto gz_file = file + ".gz";
+        auto tmp_file = gz_file + ".tmp";
+        auto idx_file = gz_file + ".idx";
+
+        std::FILE* in = std::fopen(file.c_str(), "rb");
+        if (!in)
+        {
+            return false;
+        }
+        std::FILE* out = std::fopen(tmp_file.c_str(), "wb");
+        if (!out)
+        {
+            std::fclose(in);
+            return false;
+        }
+
+        z_stream zs{};
+        if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            std::fclose(in);
+            std::fclose(out);
+            std::remove(tmp_file.c_str());
+            return false;
+        }
+
+        std::vector<char> in_buf(chunk_bytes);
+        std::vector<char> out_buf(chunk_bytes);
+        std::string idx = "aalog-idx 1\n";
+        std::uint64_t raw_off = 0;
+        std::uint64_t gz_off = 0;
+        std::uint64_t member_raw = 0;
+        bool is_member_open = false;
+        bool is_ok = true;
+
+        auto feed = [&](const char* p, std::size_t size, int flush)
+        {
+            zs.next_in = (Bytef*)p;
+            zs.avail_in = (uInt)size;
+            do
+            {
+                zs.next_out = (Bytef*)out_buf.data();
+                zs.avail_out = (uInt)out_buf.size();
+                auto ret = deflate(&zs, flush);
+                if (ret == Z_STREAM_ERROR)
+                {
+                    return false;
+                }
+                auto n = out_buf.size() - zs.avail_out;
+                if (n && std::fwrite(out_buf.data(), 1, n, out) != n)
+                {
+                    return false;
+                }
+                gz_off += n;
+            } while (zs.avail_out == 0);
+            return true;
+        };
+
+        auto is_stopping = [this]()
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            return is_stop_;
+        };
+
+        while (is_ok)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            auto n = std::fread(in_buf.data(), 1, in_buf.size(), in);
+            if (n == 0)
+            {
+                break;
+            }
+
+            const char* p = in_buf.data();
+            std::size_t remain = n;
+            while (remain && is_ok)
+            {
+                if (!is_member_open)
+                {
+                    char tmp[64];
+                    auto t = line_time(p, remain);
+                    auto len = std::snprintf(tmp, sizeof(tmp), "%llu %llu ", (unsigned long long)raw_off, (unsigned long long)gz_off);
+                    idx.append(tmp, len).append(t).append("\n");
+                    is_member_open = true;
+                }
+
+                // 成员满1MB后在下一个行尾结束
+                std::size_t take = remain;
+                bool is_finish = false;
+                if (member_raw + remain >= member_bytes)
+                {
+                    std::size_t from = member_raw >= member_bytes ? 0 : member_bytes - member_raw - 1;
+                    auto nl = static_cast<const char*>(std::memchr(p + from, '\n', remain - from));
+                    if (nl)
+                    {
+                        take = nl - p + 1;
+                        is_finish = true;
+                    }
+                }
+
+                is_ok = feed(p, take, is_finish ? Z_FINISH : Z_NO_FLUSH);
+                member_raw += take;
+                raw_off += take;
+                p += take;
+                remain -= take;
+                if (is_finish)
+                {
+                    deflateReset(&zs);
+                    is_member_open = false;
+                    member_raw = 0;
+                }
+            }
+
+            if (is_stopping())
+            {
+                is_ok = false;
+                break;
+            }
+            auto busy = std::chrono::steady_clock::now() - begin;
+            if (cpu_percent < 100)
+            {
+                std::this_thread::sleep_for(busy * (100 - cpu_percent) / cpu_percent);
+            }
+        }
+
+        if (is_ok && std::ferror(in))
+        {
+            is_ok = false;
+        }
+        if (is_ok && is_member_open)
+        {
+            is_ok = feed(nullptr, 0, Z_FINISH);
+        }
+        deflateEnd(&zs);
+        std::fclose(in);
+        is_ok = sync_file(out) && is_ok;
+        std::fclose(out);
+
+        std::FILE* idx_fp = is_ok ? std::fopen(idx_file.c_str(), "wb") : nullptr;
+        if (idx_fp)
+        {
+            is_ok = std::fwrite(idx.data(), 1, idx.size(), idx_fp) == idx.size() && sync_file(idx_fp);
+            std::fclose(idx_fp);
+        }
+        if (!idx_fp || !is_ok || std::rename(tmp_file.c_str(), gz_file.c_str()) != 0)
+        {
+            std::remove(tmp_file.c_str());
+            std::remove(idx_file.c_str());
+            return false;
+        }
+        std::remove(file.c_str());
+        return true;
+    }
+
+    void log_retention::sweep()
+    {
+        namespace fs = std::filesystem;
+
+        std::string dir;
+        std::string file_tag;
+        std::unordered_set<std::string> active;
+        std::uint32_t max_files;
+        std::uint64_t max_bytes;
+        std::uint64_t max_age_sec;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (dir_.empty() || !(max_files_ || max_bytes_ || max_age_sec_))
+            {
+                return;
+            }
+            dir = dir_;
+            file_tag = file_tag_;
+            active = active_;
+            max_files = max_files_;
+            max_bytes = max_bytes_;
+            max_age_sec = max_age_sec_;
+        }
+
+        std::vector<old_file> files;
+        std::uint64_t total_bytes = 0;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            auto name = it->path().filename().string();
+            auto is_log = name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0;
+            auto is_gz = name.size() > 7 && name.compare(name.size() - 7, 7, ".log.gz") == 0;
+            if (name.find(file_tag) == std::string::npos || !(is_log || is_gz))
+            {
+                continue;
+            }
+            std::error_code fec;
+            if (!it->is_regular_file(fec))
+            {
+                continue;
+            }
+            auto size = it->file_size(fec);
+            auto mtime = it->last_write_time(fec);
+            if (fec)
+            {
+                continue;
+            }
+            files.push_back({it->path(), mtime, size, active.count(it->path().string()) > 0});
+            total_bytes += size;
+        }
+
+        // 最旧的在前
+        std::sort(files.begin(), files.end(),
+            [](const old_file& a, const old_file& b)
+            {
+                return a.mtime_ != b.mtime_ ? a.mtime_ < b.mtime_ : a.path_ < b.path_;
+            });
+
+        auto now = fs::file_time_type::clock::now();
+        auto max_age = std::chrono::seconds(max_age_sec);
+        std::size_t count = files.size();
+        std::size_t removed_count = 0;
+        std::uint64_t removed_bytes = 0;
+        for (auto& f : files)
+        {
+            auto is_over = (max_files && count > max_files)
+                || (max_bytes && total_bytes > max_bytes)
+                || (max_age_sec && now - f.mtime_ > max_age);
+            if (!is_over)
+            {
+                if (!max_age_sec)
+                {
+                    break;  // 数量和字节都已达标，后面的只会更新
+                }
+                continue;
+            }
+            if (f.is_active_)
+            {
+                continue;
+            }
+            std::error_code rec;
+            if (!fs::remove(f.path_, rec) || rec)
+            {
+                continue;
+            }
+            if (f.path_.extension() == ".gz")
+            {
+                fs::remove(f.path_.string() + ".idx", rec);
+            }
+            --count;
+            total_bytes -= f.size_;
+            ++removed_count;
+            removed_bytes += f.size_;
+        }
+
+        if (removed_count)
+        {
+            alog::info("日志保留：删除{}个旧文件，共{}字节，剩余{}个文件，共{}字节", removed_count, removed_bytes, count, total_bytes);
+        }
+    }
+}
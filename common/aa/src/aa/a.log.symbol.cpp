@@ -0,0 +1,973 @@
+#include "ahcpp.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cstring>
+#include <cinttypes>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "a.log.h"
+
+// 进程内符号解析：ELF符号表 + DWARF行号表（.debug_line），模块文件mmap后只解析一次，
+//    结果按运行时地址LRU缓存，代替逐帧popen(addr2line)
+
+namespace alog
+{
+    namespace
+    {
+        // DWARF常量（.debug_line用到的部分）
+        enum : std::uint64_t
+        {
+            DW_FORM_block = 0x09,
+            DW_FORM_data1 = 0x0b,
+            DW_FORM_data2 = 0x05,
+            DW_FORM_data4 = 0x06,
+            DW_FORM_data8 = 0x07,
+            DW_FORM_data16 = 0x1e,
+            DW_FORM_string = 0x08,
+            DW_FORM_strp = 0x0e,
+            DW_FORM_udata = 0x0f,
+            DW_FORM_line_strp = 0x1f,
+            DW_FORM_strx = 0x1a,
+            DW_FORM_strx1 = 0x25,
+            DW_FORM_strx2 = 0x26,
+            DW_FORM_strx3 = 0x27,
+            DW_FORM_strx4 = 0x28,
+
+            DW_LNCT_path = 0x1,
+            DW_LNCT_directory_index = 0x2,
+
+            DW_LNS_copy = 1,
+            DW_LNS_advance_pc = 2,
+            DW_LNS_advance_line = 3,
+            DW_LNS_set_file = 4,
+            DW_LNS_const_add_pc = 8,
+            DW_LNS_fixed_advance_pc = 9,
+
+            DW_LNE_end_sequence = 1,
+            DW_LNE_set_address = 2
+        };
+
+        struct elf_symbol
+        {
+            std::uint64_t addr_;
+            std::uint64_t size_;
+            const char* name_;
+        };
+
+        struct line_row
+        {
+            std::uint64_t addr_;
+            std::uint32_t file_;
+            std::uint32_t line_;
+            bool is_end_;           // 序列结束（其后地址不属于本序列）
+        };
+
+        // DWARF字节读取，越界后ok_为false且后续读取均返回0
+        class dwarf_reader
+        {
+        public:
+            dwarf_reader(const std::uint8_t* p, const std::uint8_t* end)
+                : p_(p), end_(end)
+            {
+            }
+
+            template<typename T>
+            T read()
+            {
+                T v = 0;
+                if (!need(sizeof(T)))
+                {
+                    return 0;
+                }
+                std::memcpy(&v, p_, sizeof(T));
+                p_ += sizeof(T);
+                return v;
+            }
+
+            std::uint64_t uleb()
+            {
+                std::uint64_t v = 0;
+                int shift = 0;
+                while (need(1))
+                {
+                    auto b = *p_++;
+                    if (shift < 64)
+                    {
+                        v |= std::uint64_t(b & 0x7f) << shift;
+                    }
+                    shift += 7;
+                    if (!(b & 0x80))
+                    {
+                        break;
+                    }
+                }
+                return v;
+            }
+
+            std::int64_t sleb()
+            {
+                std::int64_t v = 0;
+                int shift = 0;
+                std::uint8_t b = 0;
+                while (need(1))
+                {
+                    b = *p_++;
+                    if (shift < 64)
+                    {
+                        v |= std::int64_t(b & 0x7f) << shift;
+                    }
+                    shift += 7;
+                    if (!(b & 0x80))
+                    {
+                        break;
+                    }
+                }
+                if (shift < 64 && (b & 0x40))
+                {
+                    v |= -(std::int64_t(1) << shift);
+                }
+                return v;
+            }
+
+            const char* cstr()
+            {
+                auto s = reinterpret_cast<const char*>(p_);
+                auto e = static_cast<const std::uint8_t*>(std::memchr(p_, 0, end_ - p_));
+                if (!e)
+                {
+                    ok_ = false;
+                    p_ = end_;
+                    return "";
+                }
+                p_ = e + 1;
+                return s;
+            }
+
+            std::uint64_t offset(bool is64)
+            {
+                return is64 ? read<std::uint64_t>() : read<std::uint32_t>();
+            }
+
+            std::uint64_t address(int size)
+            {
+                if (size == 4)
+                {
+                    return read<std::uint32_t>();
+                }
+                if (size == 8)
+                {
+                    return read<std::uint64_t>();
+                }
+                skip(size);
+                return 0;
+            }
+
+            void skip(std::uint64_t n)
+            {
+                if (need(n))
+                {
+                    p_ += n;
+                }
+            }
+
+            bool ok() const
+            {
+                return ok_ && p_ <= end_;
+            }
+
+            bool at_end() const
+            {
+                return p_ >= end_;
+            }
+
+            const std::uint8_t* ptr() const
+            {
+                return p_;
+            }
+
+        private:
+            bool need(std::uint64_t n)
+            {
+                if (!ok_ || std::uint64_t(end_ - p_) < n)
+                {
+                    ok_ = false;
+                    p_ = end_;
+                    return false;
+                }
+                return true;
+            }
+
+            const std::uint8_t* p_;
+            const std::uint8_t* end_;
+            bool ok_ = true;
+        };
+
+        struct elf_section
+        {
+            const std::uint8_t* data_ = nullptr;
+            std::size_t size_ = 0;
+        };
+
+        // 一个已加载模块（可执行文件或so）
+        class elf_module
+        {
+        public:
+            elf_module(std::string path, std::uint64_t bias)
+                : path_(std::move(path)), bias_(bias)
+            {
+                auto pos = path_.rfind('/');
+                name_ = pos == std::string::npos ? path_ : path_.substr(pos + 1);
+            }
+
+            ~elf_module()
+            {
+                if (map_)
+                {
+                    munmap(map_, map_size_);
+                }
+            }
+
+            bool contains(std::uint64_t addr) const
+            {
+                for (auto& r : ranges_)
+                {
+                    if (addr >= r.first && addr < r.second)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void load();
+            const elf_symbol* find_symbol(std::uint64_t rel) const;
+            const line_row* find_line(std::uint64_t rel) const;
+
+        public:
+            std::string path_;
+            std::string name_;
+            std::uint64_t bias_;
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges_;   // 运行时地址区间
+            std::vector<std::string> files_;
+
+        private:
+            elf_section find_section(const char* name) const;
+            void parse_symbols();
+            void parse_lines();
+            bool parse_line_unit(dwarf_reader& rd, std::unordered_map<std::string, std::uint32_t>& file_ids);
+            const char* read_form_str(dwarf_reader& rd, std::uint64_t form, bool is64);
+
+            bool is_loaded_ = false;
+            void* map_ = nullptr;
+            std::size_t map_size_ = 0;
+            std::vector<elf_symbol> syms_;
+            std::vector<line_row> rows_;
+            elf_section line_str_;
+            elf_section str_;
+        };
+
+        void elf_module::load()
+        {
+            if (is_loaded_)
+            {
+                return;
+            }
+            is_loaded_ = true;
+
+            int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                return;
+            }
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && st.st_size > (off_t)sizeof(Elf64_Ehdr))
+            {
+                auto p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED)
+                {
+                    map_ = p;
+                    map_size_ = st.st_size;
+                }
+            }
+            ::close(fd);
+            if (!map_)
+            {
+                return;
+            }
+
+            auto eh = static_cast<const Elf64_Ehdr*>(map_);
+            if (std::memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS64
+                || eh->e_shoff == 0 || eh->e_shentsize != sizeof(Elf64_Shdr)
+                || eh->e_shoff + std::uint64_t(eh->e_shnum) * sizeof(Elf64_Shdr) > map_size_
+                || eh->e_shstrndx >= eh->e_shnum)
+            {
+                return;
+            }
+
+            line_str_ = find_section(".debug_line_str");
+            str_ = find_section(".debug_str");
+            parse_symbols();
+            parse_lines();
+        }
+
+        elf_section elf_module::find_section(const char* name) const
+        {
+            auto base = static_cast<const std::uint8_t*>(map_);
+            auto eh = reinterpret_cast<const Elf64_Ehdr*>(base);
+            auto sh = reinterpret_cast<const Elf64_Shdr*>(base + eh->e_shoff);
+            auto& strsh = sh[eh->e_shstrndx];
+            if (strsh.sh_offset + strsh.sh_size > map_size_)
+            {
+                return {};
+            }
+            auto names = reinterpret_cast<const char*>(base + strsh.sh_offset);
+            for (int i = 0; i < eh->e_shnum; ++i)
+            {
+                if (sh[i].sh_name >= strsh.sh_size || std::strcmp(names + sh[i].sh_name, name) != 0)
+                {
+                    continue;
+                }
+                // 压缩的调试段（SHF_COMPRESSED）与无内容段不解析
+                if (sh[i].sh_type == SHT_NOBITS || (sh[i].sh_flags & SHF_COMPRESSED)
+                    || sh[i].sh_offset + sh[i].sh_size > map_size_)
+                {
+                    return {};
+                }
+                return {base + sh[i].sh_offset, static_cast<std::size_t>(sh[i].sh_size)};
+            }
+            return {};
+        }
+
+        void elf_module::parse_symbols()
+        {
+            auto syms = find_section(".symtab");
+            auto strs = find_section(".strtab");
+            if (!syms.data_ || !strs.data_)
+            {
+                // strip过的模块只有动态符号表
+                syms = find_section(".dynsym");
+                strs = find_section(".dynstr");
+            }
+            if (!syms.data_ || !strs.data_)
+            {
+                return;
+            }
+
+            auto p = reinterpret_cast<const Elf64_Sym*>(syms.data_);
+            auto n = syms.size_ / sizeof(Elf64_Sym);
+            syms_.reserve(n);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                auto type = ELF64_ST_TYPE(p[i].st_info);
+                if ((type != STT_FUNC && type != STT_GNU_IFUNC) || p[i].st_shndx == SHN_UNDEF
+                    || !p[i].st_value || p[i].st_name >= strs.size_)
+                {
+                    continue;
+                }
+                syms_.push_back({p[i].st_value, p[i].st_size, reinterpret_cast<const char*>(strs.data_) + p[i].st_name});
+            }
+            std::sort(syms_.begin(), syms_.end(),
+                [](const elf_symbol& a, const elf_symbol& b)
+                {
+                    return a.addr_ < b.addr_ || (a.addr_ == b.addr_ && a.size_ < b.size_);
+                });
+        }
+
+        const char* elf_module::read_form_str(dwarf_reader& rd, std::uint64_t form, bool is64)
+        {
+            auto from = [](const elf_section& sec, std::uint64_t off) -> const char*
+                {
+                    if (!sec.data_ || off >= sec.size_)
+                    {
+                        return "";
+                    }
+                    return reinterpret_cast<const char*>(sec.data_) + off;
+                };
+
+            switch (form)
+            {
+            case DW_FORM_string:
+                return rd.cstr();
+            case DW_FORM_line_strp:
+                return from(line_str_, rd.offset(is64));
+            case DW_FORM_strp:
+                return from(str_, rd.offset(is64));
+            default:
+                return nullptr;
+            }
+        }
+
+        // 跳过行号表头中不关心的属性值
+        static void skip_form(dwarf_reader& rd, std::uint64_t form, bool is64)
+        {
+            switch (form)
+            {
+            case DW_FORM_data1:
+            case DW_FORM_strx1:
+                rd.skip(1);
+                break;
+            case DW_FORM_data2:
+            case DW_FORM_strx2:
+                rd.skip(2);
+                break;
+            case DW_FORM_strx3:
+                rd.skip(3);
+                break;
+            case DW_FORM_data4:
+            case DW_FORM_strx4:
+                rd.skip(4);
+                break;
+            case DW_FORM_data8:
+                rd.skip(8);
+                break;
+            case DW_FORM_data16:
+                rd.skip(16);
+                break;
+            case DW_FORM_udata:
+            case DW_FORM_strx:
+                rd.uleb();
+                break;
+            case DW_FORM_block:
+                rd.skip(rd.uleb());
+                break;
+            case DW_FORM_string:
+                rd.cstr();
+                break;
+            case DW_FORM_strp:
+            case DW_FORM_line_strp:
+                rd.offset(is64);
+                break;
+            default:
+                rd.skip(UINT64_MAX);    // 未知格式，放弃本单元
+                break;
+            }
+        }
+
+        void elf_module::parse_lines()
+        {
+            auto sec = find_section(".debug_line");
+            if (!sec.data_)
+            {
+                return;
+            }
+            std::unordered_map<std::string, std::uint32_t> file_ids;
+            dwarf_reader rd(sec.data_, sec.data_ + sec.size_);
+            while (!rd.at_end() && rd.ok())
+            {
+                if (!parse_line_unit(rd, file_ids))
+                {
+                    break;
+                }
+            }
+
+            // 同地址时序列结束在前、新序列起始在后，查找取最后一个<=地址的行
+            std::sort(rows_.begin(), rows_.end(),
+                [](const line_row& a, const line_row& b)
+                {
+                    return a.addr_ < b.addr_ || (a.addr_ == b.addr_ && a.is_end_ && !b.is_end_);
+                });
+            rows_.shrink_to_fit();
+        }
+
+        bool elf_module::parse_line_unit(dwarf_reader& rd, std::unordered_map<std::string, std::uint32_t>& file_ids)
+        {
+            bool is64 = false;
+            std::uint64_t unit_length = rd.read<std::uint32_t>();
+            if (unit_length == 0xffffffff)
+            {
+                is64 = true;
+                unit_length = rd.read<std::uint64_t>();
+            }
+            if (!rd.ok() || unit_length > std::uint64_t(1) << 40)
+            {
+                return false;
+            }
+            auto unit_begin = rd.ptr();
+            dwarf_reader unit(unit_begin, unit_begin + unit_length);
+            rd.skip(unit_length);
+            if (!rd.ok())
+            {
+                return false;
+            }
+
+            auto version = unit.read<std::uint16_t>();
+            if (version < 2 || version > 5)
+            {
+                return true;
+            }
+            if (version >= 5)
+            {
+                unit.read<std::uint8_t>();      // address_size
+                unit.read<std::uint8_t>();      // segment_selector_size
+            }
+            auto header_length = unit.offset(is64);
+            auto program = unit.ptr() + header_length;
+            auto min_inst = unit.read<std::uint8_t>();
+            if (version >= 4)
+            {
+                unit.read<std::uint8_t>();      // maximum_operations_per_instruction
+            }
+            unit.read<std::uint8_t>();          // default_is_stmt
+            auto line_base = unit.read<std::int8_t>();
+            auto line_range = unit.read<std::uint8_t>();
+            auto opcode_base = unit.read<std::uint8_t>();
+            std::uint8_t std_lengths[256] = {};
+            for (int i = 1; i < opcode_base; ++i)
+            {
+                std_lengths[i] = unit.read<std::uint8_t>();
+            }
+            if (!unit.ok() || !line_range)
+            {
+                return true;
+            }
+
+            // 目录与文件表，文件名拼成完整路径后全模块去重
+            std::vector<const char*> dirs;
+            std::vector<std::pair<const char*, std::uint64_t>> names;
+            if (version >= 5)
+            {
+                auto read_entries = [&](bool is_file)
+                    {
+                        std::uint8_t format_count = unit.read<std::uint8_t>();
+                        std::vector<std::pair<std::uint64_t, std::uint64_t>> formats;
+                        for (int i = 0; i < format_count; ++i)
+                        {
+                            auto type = unit.uleb();
+                            auto form = unit.uleb();
+                            formats.emplace_back(type, form);
+                        }
+                        auto count = unit.uleb();
+                        for (std::uint64_t i = 0; i < count && unit.ok(); ++i)
+                        {
+                            const char* path = "";
+                            std::uint64_t dir = 0;
+                            for (auto& [type, form] : formats)
+                            {
+                                if (type == DW_LNCT_path)
+                                {
+                                    auto s = read_form_str(unit, form, is64);
+                                    if (s)
+                                    {
+                                        path = s;
+                                    }
+                                    else
+                                    {
+                                        skip_form(unit, form, is64);
+                                    }
+                                }
+                                else if (type == DW_LNCT_directory_index && form == DW_FORM_udata)
+                                {
+                                    dir = unit.uleb();
+                                }
+                                else if (type == DW_LNCT_directory_index && form == DW_FORM_data1)
+                                {
+                                    dir = unit.read<std::uint8_t>();
+                                }
+                                else if (type == DW_LNCT_directory_index && form == DW_FORM_data2)
+                                {
+                                    dir = unit.read<std::uint16_t>();
+                                }
+                                else
+                                {
+                                    skip_form(unit, form, is64);
+                                }
+                            }
+                            if (is_file)
+                            {
+                                names.emplace_back(path, dir);
+                            }
+                            else
+                            {
+                                dirs.push_back(path);
+                            }
+                        }
+                    };
+                read_entries(false);
+                read_entries(true);
+            }
+            else
+            {
+                dirs.push_back("");     // 目录0为编译目录，v4及以前未记录在此
+                while (unit.ok())
+                {
+                    auto s = unit.cstr();
+                    if (!*s)
+                    {
+                        break;
+                    }
+                    dirs.push_back(s);
+                }
+                names.emplace_back("", 0);  // 文件序号从1开始
+                while (unit.ok())
+                {
+                    auto s = unit.cstr();
+                    if (!*s)
+                    {
+                        break;
+                    }
+                    auto dir = unit.uleb();
+                    unit.uleb();
+                    unit.uleb();
+                    names.emplace_back(s, dir);
+                }
+            }
+            if (!unit.ok())
+            {
+                return true;
+            }
+
+            std::vector<std::uint32_t> ids(names.size(), 0);
+            auto file_id = [&](std::uint64_t idx) -> std::uint32_t
+                {
+                    if (idx >= names.size())
+                    {
+                        return 0;
+                    }
+                    if (ids[idx])
+                    {
+                        return ids[idx];
+                    }
+                    std::string full;
+                    auto& [name, dir] = names[idx];
+                    if (name[0] != '/' && dir < dirs.size() && *dirs[dir])
+                    {
+                        full = dirs[dir];
+                        full += '/';
+                    }
+                    full += name;
+                    auto it = file_ids.find(full);
+                    if (it == file_ids.end())
+                    {
+                        if (files_.empty())
+                        {
+                            files_.emplace_back("??");      // 0：未知文件
+                        }
+                        it = file_ids.emplace(full, (std::uint32_t)files_.size()).first;
+                        files_.push_back(std::move(full));
+                    }
+                    ids[idx] = it->second;
+                    return it->second;
+                };
+
+            // 行号状态机
+            dwarf_reader prog(program, unit_begin + unit_length);
+            std::vector<line_row> seq;
+            std::uint64_t address = 0;
+            std::uint64_t file = 1;
+            std::int64_t line = 1;
+            auto emit = [&](bool is_end)
+                {
+                    seq.push_back({address, file_id(file), (std::uint32_t)line, is_end});
+                };
+            auto reset = [&]()
+                {
+                    address = 0;
+                    file = 1;
+                    line = 1;
+                };
+
+            while (!prog.at_end() && prog.ok())
+            {
+                auto op = prog.read<std::uint8_t>();
+                if (op >= opcode_base)
+                {
+                    int adj = op - opcode_base;
+                    address += std::uint64_t(adj / line_range) * min_inst;
+                    line += line_base + adj % line_range;
+                    emit(false);
+                    continue;
+                }
+                switch (op)
+                {
+                case 0:
+                {
+                    auto len = prog.uleb();
+                    if (!len)
+                    {
+                        break;
+                    }
+                    auto sub = prog.read<std::uint8_t>();
+                    if (sub == DW_LNE_end_sequence)
+                    {
+                        emit(true);
+                        // 被链接器丢弃的函数地址为0或-1，整段不要
+                        if (!seq.empty() && seq.front().addr_ != 0 && seq.front().addr_ != ~std::uint64_t(0)
+                            && seq.front().addr_ != 0xffffffff)
+                        {
+                            rows_.insert(rows_.end(), seq.begin(), seq.end());
+                        }
+                        seq.clear();
+                        reset();
+                    }
+                    else if (sub == DW_LNE_set_address)
+                    {
+                        address = prog.address((int)len - 1);
+                    }
+                    else
+                    {
+                        prog.skip(len - 1);
+                    }
+                    break;
+                }
+                case DW_LNS_copy:
+                    emit(false);
+                    break;
+                case DW_LNS_advance_pc:
+                    address += prog.uleb() * min_inst;
+                    break;
+                case DW_LNS_advance_line:
+                    line += prog.sleb();
+                    break;
+                case DW_LNS_set_file:
+                    file = prog.uleb();
+                    break;
+                case DW_LNS_const_add_pc:
+                    address += std::uint64_t((255 - opcode_base) / line_range) * min_inst;
+                    break;
+                case DW_LNS_fixed_advance_pc:
+                    address += prog.read<std::uint16_t>();
+                    break;
+                default:
+                    for (int i = 0; i < std_lengths[op]; ++i)
+                    {
+                        prog.uleb();
+                    }
+                    break;
+                }
+            }
+            return true;
+        }
+
+        const elf_symbol* elf_module::find_symbol(std::uint64_t rel) const
+        {
+            auto it = std::upper_bound(syms_.begin(), syms_.end(), rel,
+                [](std::uint64_t v, const elf_symbol& s)
+                {
+                    return v < s.addr_;
+                });
+            if (it == syms_.begin())
+            {
+                return nullptr;
+            }
+            --it;
+            if (it->size_ && rel >= it->addr_ + it->size_)
+            {
+                return nullptr;
+            }
+            return &*it;
+        }
+
+        const line_row* elf_module::find_line(std::uint64_t rel) const
+        {
+            auto it = std::upper_bound(rows_.begin(), rows_.end(), rel,
+                [](std::uint64_t v, const line_row& r)
+                {
+                    return v < r.addr_;
+                });
+            if (it == rows_.begin())
+            {
+                return nullptr;
+            }
+            --it;
+            if (it->is_end_)
+            {
+                return nullptr;
+            }
+            return &*it;
+        }
+
+        // ------------------------------------------------------------------------------// 模块数据对象
+        // ------------------------------------------------------------------------------
+        class mdata
+        {
+        public:
+            static constexpr std::size_t cache_capacity = 4096;
+
+            std::mutex mtx_;
+            std::vector<std::unique_ptr<elf_module>> modules_;
+
+            // 地址 -> 已格式化的帧文本（LRU）
+            std::list<std::pair<std::uint64_t, std::string>> lru_;
+            std::unordered_map<std::uint64_t, std::list<std::pair<std::uint64_t, std::string>>::iterator> cache_;
+
+            elf_module* find_module(std::uint64_t addr);
+            void refresh_modules();
+            std::string format_frame(std::uint64_t addr);
+        };
+
+        mdata md_;
+
+        // 重新枚举已加载模块（dlopen后会有新模块），已有模块保留解析结果
+        void mdata::refresh_modules()
+        {
+            std::vector<std::unique_ptr<elf_module>> found;
+            dl_iterate_phdr(
+                [](struct dl_phdr_info* info, std::size_t, void* ud) -> int
+                {
+                    auto& found = *static_cast<std::vector<std::unique_ptr<elf_module>>*>(ud);
+                    std::string path = info->dlpi_name && *info->dlpi_name ? info->dlpi_name : "";
+                    if (path.empty())
+                    {
+                        if (!found.empty())
+                        {
+                            return 0;   // vdso等无文件模块
+                        }
+                        char exe[4096];
+                        auto n = ::readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+                        path = n > 0 ? std::string(exe, n) : "/proc/self/exe";
+                    }
+                    auto m = std::make_unique<elf_module>(path, info->dlpi_addr);
+                    for (int i = 0; i < info->dlpi_phnum; ++i)
+                    {
+                        auto& ph = info->dlpi_phdr[i];
+                        if (ph.p_type == PT_LOAD)
+                        {
+                            m->ranges_.emplace_back(info->dlpi_addr + ph.p_vaddr, info->dlpi_addr + ph.p_vaddr + ph.p_memsz);
+                        }
+                    }
+                    found.push_back(std::move(m));
+                    return 0;
+                },
+                &found);
+
+            for (auto& m : found)
+            {
+                for (auto& old : modules_)
+                {
+                    if (old && old->path_ == m->path_ && old->bias_ == m->bias_)
+                    {
+                        m = std::move(old);
+                        break;
+                    }
+                }
+            }
+            modules_ = std::move(found);
+        }
+
+        elf_module* mdata::find_module(std::uint64_t addr)
+        {
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                for (auto& m : modules_)
+                {
+                    if (m->contains(addr))
+                    {
+                        return m.get();
+                    }
+                }
+                if (pass == 0)
+                {
+                    refresh_modules();
+                }
+            }
+            return nullptr;
+        }
+
+        static void append_hex(std::string& out, std::uint64_t v)
+        {
+            char tmp[24];
+            auto n = std::snprintf(tmp, sizeof(tmp), "0x%" PRIx64, v);
+            out.append(tmp, n);
+        }
+
+        // 帧格式：<地址>: <文件:行号> (<函数>+0x<函数内偏移>)
+        //    无行号信息时以模块名代替文件，无符号时为(+0x<模块内偏移>)
+        std::string mdata::format_frame(std::uint64_t addr)
+        {
+            std::string out;
+            append_hex(out, addr);
+            out += ": ";
+
+            auto m = find_module(addr);
+            if (!m)
+            {
+                out += "??\n";
+                return out;
+            }
+            m->load();
+
+            auto rel = addr - m->bias_;
+            // 返回地址指向调用的下一条指令，行号按调用指令查
+            auto line = m->find_line(rel ? rel - 1 : rel);
+            if (line && line->file_ < m->files_.size())
+            {
+                out += m->files_[line->file_];
+                out += ':';
+                out += std::to_string(line->line_);
+            }
+            else
+            {
+                out += m->name_;
+            }
+
+            out += " (";
+            auto sym = m->find_symbol(rel ? rel - 1 : rel);
+            if (sym)
+            {
+                int status = 0;
+                char* dem = abi::__cxa_demangle(sym->name_, nullptr, nullptr, &status);
+                out += status == 0 && dem ? dem : sym->name_;
+                std::free(dem);
+                out += '+';
+                append_hex(out, rel - sym->addr_);
+            }
+            else
+            {
+                out += '+';
+                append_hex(out, rel);
+            }
+            out += ")\n";
+            return out;
+        }
+    }
+
+    std::size_t symbolize_to_buf(char* buf, std::size_t buf_size, std::size_t offset, std::uint64_t addr)
+    {
+        auto md = &md_;
+        std::lock_guard<std::mutex> lock(md->mtx_);
+
+        const std::string* text;
+        auto it = md->cache_.find(addr);
+        if (it != md->cache_.end())
+        {
+            md->lru_.splice(md->lru_.begin(), md->lru_, it->second);
+            text = &it->second->second;
+        }
+        else
+        {
+            md->lru_.emplace_front(addr, md->format_frame(addr));
+            md->cache_[addr] = md->lru_.begin();
+            if (md->lru_.size() > md->cache_capacity)
+            {
+                md->cache_.erase(md->lru_.back().first);
+                md->lru_.pop_back();
+            }
+            text = &md->lru_.front().second;
+        }
+
+        if (offset + text->size() >= buf_size)
+        {
+            return offset;
+        }
+        std::memcpy(buf + offset, text->data(), text->size());
+        return offset + text->size();
+    }
+}
+
+#endif
@@ -8,6 +8,10 @@
 #else
 #   include <unistd.h>
 #   include <pthread.h>
+#   include <execinfo.h>
+#   include <sys/syscall.h>
+#   include <atomic>
+#   include <memory>
 #   include <mutex>
 #   include <condition_variable>
 #   include <thread>
@@ -140,6 +144,15 @@ void sys_signal::wait()
     Sleep(INFINITE);
 }
 
+// Windows的致命异常由seh_handler处理
+void set_crash_handler(crash_handler_t)
+{
+}
+
+void setup_altstack()
+{
+}
+
 // ---------------------------------------------------------------------------
 // Linux 实现
 // ---------------------------------------------------------------------------
@@ -219,6 +232,80 @@ void sys_signal::wait()
     g_cv.wait(lock, [] { return g_exit_flag; });
 }
 
+// ---------------------------------------------------------------------------
+// 致命信号
+// ---------------------------------------------------------------------------
+namespace
+{
+    const int              g_fatal_sigs[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    crash_handler_t        g_crash_handler = nullptr;
+    std::atomic_long       g_crash_tid {0};
+
+    void on_fatal(int sig, siginfo_t* info, void* ucontext)
+    {
+        long tid = syscall(SYS_gettid);
+        long expected = 0;
+        if (g_crash_tid.compare_exchange_strong(expected, tid))
+        {
+            if (g_crash_handler)
+            {
+                g_crash_handler(sig, info, ucontext);
+            }
+        }
+        else if (expected != tid)
+        {
+            // 其它线程正在处理，等它结束进程
+            while (true)
+            {
+                pause();
+            }
+        }
+        // 处理函数自身出错时（expected == tid）直接按默认处理
+
+        signal(sig, SIG_DFL);
+        raise(sig);
+    }
+}
+
+void setup_altstack()
+{
+    static thread_local std::unique_ptr<char[]> stack;
+    if (stack)
+    {
+        return;
+    }
+    std::size_t size = 64 * 1024;
+    if ((std::size_t)SIGSTKSZ > size)
+    {
+        size = SIGSTKSZ;
+    }
+    stack.reset(new char[size]);
+    stack_t ss {};
+    ss.ss_sp = stack.get();
+    ss.ss_size = size;
+    ss.ss_flags = 0;
+    sigaltstack(&ss, nullptr);
+}
+
+void set_crash_handler(crash_handler_t fn)
+{
+    // backtrace首次调用会加载libgcc，先在正常上下文调用一次
+    void* frames[4];
+    backtrace(frames, 4);
+
+    g_crash_handler = fn;
+    setup_altstack();
+
+    struct sigaction sa {};
+    sa.sa_sigaction = on_fatal;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    for (int s : g_fatal_sigs)
+    {
+        sigaction(s, &sa, nullptr);
+    }
+}
+
 #endif // _WIN32
 
 } // namespace xsys
\ No newline at end of file
@@ -16,6 +16,13 @@ using handler_t = std::function<void(int)>;
 void block_all_signals();
 void unblock_all_signals();
 
+// 致命信号处理（Linux）：SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT在出错线程的备用栈上同步调用fn，
+//    fn只能用异步信号安全的调用；多个线程同时出错只有第一个调用fn，fn返回后按默认处理结束进程（生成core）
+using crash_handler_t = void (*)(int sig, void* info, void* ucontext);
+void set_crash_handler(crash_handler_t fn);
+// 为当前线程安装备用信号栈（栈溢出时处理函数仍能运行），每个线程首次调用时安装
+void setup_altstack();
+
 // 信号管理类
 class sys_signal
 {
@@ -10,9 +10,13 @@
 #include <thread>
 #include <iostream>
 
+#include <algorithm>
+
 #include "aos.h"
 #include "alog.h"
+#include "atime.h"
 #include "a.thread.h"
+#include "a.signal.h"
 
 namespace athd
 {
@@ -91,13 +95,139 @@ namespace athd
 
     thread_local void* curr_job_restul_;
     thread_local bool curr_job_end_;
+    thread_local int curr_job_status_ = STATUS_OK;
+
+    static void unref_token(token_impl* tk)
+    {
+        if (tk && tk->ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete tk;
+        }
+    }
+
+    int thread_impl::check_status(node* n)
+    {
+        if (n->token_ && n->token_->epoch_.load(std::memory_order_acquire) != n->epoch_)
+        {
+            return STATUS_CANCELLED;
+        }
+        if (n->deadline_ && atime::nsec() > n->deadline_)
+        {
+            return STATUS_TIMEOUT;
+        }
+        if (!n->cid_ || !cancel_cid_count_.load(std::memory_order_acquire))
+        {
+            return STATUS_OK;
+        }
+
+        // 仅在存在按cid取消时才进锁查询
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto it = cancel_cids_.find(n->cid_);
+        if (it != cancel_cids_.end() && n->seq_ < it->second)
+        {
+            return STATUS_CANCELLED;
+        }
+        return STATUS_OK;
+    }
+
+    // 稳定排序：带截止时间的按先到期先执行，其余保持FIFO排在后面
+    void thread_impl::sort_by_deadline(node*& h, node*& t)
+    {
+        static thread_local std::vector<node*> nodes;
+        nodes.clear();
+        for (auto n = h; n; n = n->next_)
+        {
+            nodes.push_back(n);
+        }
+
+        std::stable_sort(nodes.begin(), nodes.end(),
+            [](const node* a, const node* b)
+            {
+                auto da = a->deadline_ ? a->deadline_ : UINT64_MAX;
+                auto db = b->deadline_ ? b->deadline_ : UINT64_MAX;
+                return da < db;
+            });
+
+        for (std::size_t i = 0; i + 1 < nodes.size(); ++i)
+        {
+            nodes[i]->next_ = nodes[i + 1];
+        }
+        nodes.back()->next_ = nullptr;
+        h = nodes.front();
+        t = nodes.back();
+    }
+
+    // 执行一帧，下一帧按周期从上一帧的计划时间推算（不累积漂移），
+    // 落后超过一帧则跳过错过的帧
+    void thread_impl::do_tick()
+    {
+        c_twork fn;
+        void* data;
+        std::uint64_t period;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            fn = tick_fn_;
+            data = tick_data_;
+            period = tick_period_ns_;
+        }
+        if (!period)
+        {
+            return;
+        }
+
+        auto start = atime::nsec();
+        if (fn)
+        {
+            curr_job_name_ = "tick";
+            fn(data);
+            curr_job_name_ = "";
+        }
+        auto end = atime::nsec();
+        auto frame = end - start;
+
+        tick_count_++;
+        if (frame > period)
+        {
+            overrun_count_++;
+        }
+        if (frame > max_frame_ns_)
+        {
+            max_frame_ns_ = frame;
+        }
+
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (tick_period_ns_ != period)
+        {
+            return;
+        }
+        next_tick_ns_ += period;
+        if (end > next_tick_ns_ + period)
+        {
+            auto missed = (end - next_tick_ns_) / period;
+            next_tick_ns_ += missed * period;
+            skip_count_ += missed;
+        }
+    }
+
+    void thread_impl::cancel_cid(std::uint64_t cid)
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        // 此刻之前压入（序号小于push_seq_）的同cid作业全部取消
+        cancel_cids_[cid] = push_seq_;
+        cancel_cid_count_ = (int)cancel_cids_.size();
+    }
     
     void thread_impl::exec()
     {
+        asig::setup_altstack();
         curr_thread_ = this;
         auto id = os_curr_id();
         auto md = get_mdata();
-        md->thread_map_[id] = this;
+        {
+            // 线程可由其它athd线程创建，同时启动的线程并发登记
+            std::lock_guard<std::recursive_mutex> lock(md->mtx_);
+            md->thread_map_[id] = this;
+        }
         
         {
             std::lock_guard<std::mutex> lock(mtx_);
@@ -113,21 +243,99 @@ namespace athd
         int count;
         node* h;
         node* t;
+        bool is_sort;
+        bool is_tick;
+        std::uint64_t done_seq = 0;
+        std::vector<std::pair<c_twork, void*>> retired;
+        auto has_job = [this] { return job_head_ != nullptr || (!is_working_ && !job_head_); };
         while(true)
         {
             {
                 std::unique_lock<std::mutex> lk(mtx_);
-                cv_.wait(lk, [this] { return job_head_ != nullptr || (!is_working_ && !job_head_); });
+                // 已执行过的序号不会再命中，清理按cid取消的记录
+                if (!cancel_cids_.empty())
+                {
+                    std::erase_if(cancel_cids_, [done_seq](const auto& kv) { return kv.second <= done_seq; });
+                    cancel_cid_count_ = (int)cancel_cids_.size();
+                }
+                if (!tick_period_ns_)
+                {
+                    // 其它线程athd_settick开启定帧时也要醒来
+                    cv_.wait(lk, [&] { return has_job() || tick_period_ns_ != 0; });
+                }
+                else
+                {
+                    // 定帧模式：等作业或等到下一帧
+                    auto now = atime::nsec();
+                    if (now < next_tick_ns_)
+                    {
+                        cv_.wait_for(lk, std::chrono::nanoseconds(next_tick_ns_ - now), has_job);
+                    }
+                }
+                is_tick = tick_period_ns_ && atime::nsec() >= next_tick_ns_;
+                if (!tick_retired_.empty())
+                {
+                    retired.swap(tick_retired_);
+                }
+
                 h = job_head_;
                 t = job_tail_;
-                count = job_count_;
-                job_head_ = nullptr;
-                job_tail_ = nullptr;               
+                count = 0;
+                if (h && tick_period_ns_ && tick_budget_ > 0)
+                {
+                    // 超出预算的作业留在队列，检查帧之后再执行
+                    t = h;
+                    for (int i = 1; i < tick_budget_ && t->next_; ++i)
+                    {
+                        t = t->next_;
+                    }
+                    job_head_ = t->next_;
+                    t->next_ = nullptr;
+                    if (!job_head_)
+                    {
+                        job_tail_ = nullptr;
+                    }
+                }
+                else
+                {
+                    job_head_ = nullptr;
+                    job_tail_ = nullptr;
+                }
+                if (t)
+                {
+                    done_seq = t->seq_ + 1;
+                }
+                is_sort = is_edf_ && deadline_count_ > 0;
+                if (!job_head_)
+                {
+                    deadline_count_ = 0;
+                }
             }
 
-            if (!h && !is_working_)
+            // 此时不在帧函数中，可释放被替换的帧数据
+            for (auto& [free_fn, data] : retired)
             {
-                break;
+                free_fn(data);
+            }
+            retired.clear();
+
+            if (is_tick)
+            {
+                do_tick();
+            }
+
+            if (is_sort)
+            {
+                sort_by_deadline(h, t);
+            }
+
+            if (!h)
+            {
+                if (!is_working_)
+                {
+                    break;
+                }
+                continue;
             }
 
             auto curr = h;
@@ -139,14 +347,40 @@ namespace athd
                 {
                     if (curr->work_fn_)
                     {
+                        // 已取消的作业不执行作业函数，直接回执
+                        auto status = check_status(curr);
+                        unref_token(curr->token_);
+                        curr->token_ = nullptr;
+                        if (status == STATUS_OK)
+                        {
+                            exec_count_++;
+                        }
+                        else if (status == STATUS_CANCELLED)
+                        {
+                            cancel_count_++;
+                        }
+                        else
+                        {
+                            shed_count_++;
+                        }
+
                         curr_job_restul_ = nullptr;
-                        curr->work_fn_(curr->job_ptr_);
-                        curr->sender_->push_job(
-                            (curr_job_name_ + "-result").c_str(),
-                            curr->job_ptr_,
-                            curr_job_restul_,
-                            nullptr,
-                            curr->done_fn_);
+                        if (status == STATUS_OK)
+                        {
+                            curr->work_fn_(curr->job_ptr_);
+                        }
+                        // 无回执函数的作业（如作业图节点）不回送结果节点
+                        if (curr->done_fn_)
+                        {
+                            auto rn = new_node(
+                                (curr_job_name_ + "-result").c_str(),
+                                curr->job_ptr_,
+                                curr_job_restul_,
+                                nullptr,
+                                curr->done_fn_);
+                            rn->status_ = status;
+                            curr->sender_->push_node(rn);
+                        }
                         curr_job_restul_ = nullptr;
                     }
                     else
@@ -154,8 +388,10 @@ namespace athd
                         curr->job_ptr_->job_count_--;
                         curr_job_end_ = curr->job_ptr_->job_count_ == 0;
                         curr_job_restul_ = curr->result_;
+                        curr_job_status_ = curr->status_;
                         curr->done_fn_(curr->job_ptr_);
                         curr_job_restul_ = nullptr;
+                        curr_job_status_ = STATUS_OK;
                     }
                 }
                 else
@@ -166,6 +402,7 @@ namespace athd
                 curr_job_name_ = "";
                 curr->job_name_ = "";
                 curr = curr->next_;
+                count++;
             }
 
             if (h)
@@ -179,18 +416,32 @@ namespace athd
             tfunc_(tdata_, 2);
         }
 
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (tick_free_ && tick_data_)
+            {
+                tick_retired_.emplace_back(tick_free_, tick_data_);
+            }
+            tick_fn_ = nullptr;
+            tick_data_ = nullptr;
+            tick_free_ = nullptr;
+            retired.swap(tick_retired_);
+        }
+        for (auto& [free_fn, data] : retired)
+        {
+            free_fn(data);
+        }
+
         is_stop_ = true;
     }    
 
-    void thread_impl::push_job(const char* job_name,
+    node* new_node(const char* job_name,
                 athd::pvt::job* job_ptr,
                 void* result,
                 c_twork work_fn,
-                c_tdone done_fn
-            )
+                c_tdone done_fn,
+                const job_opt* opt)
     {
-        auto ok = false;
-
         auto md = get_mdata();
         auto node = md->nodes_.alloc();
         if (job_name)
@@ -203,11 +454,53 @@ namespace athd
         node->work_fn_ = work_fn;
         node->done_fn_ = done_fn;
         node->next_ = nullptr;
+        node->token_ = nullptr;
+        node->epoch_ = 0;
+        node->cid_ = 0;
+        node->seq_ = 0;
+        node->deadline_ = 0;
+        node->status_ = STATUS_OK;
+
+        if (!opt)
+        {
+            return node;
+        }
+
+        node->deadline_ = opt->deadline_;
+        if (opt->token_)
+        {
+            auto tk = static_cast<token_impl*>(opt->token_);
+            tk->ref_count_.fetch_add(1, std::memory_order_relaxed);
+            node->token_ = tk;
+            node->epoch_ = tk->epoch_.load(std::memory_order_acquire);
+        }
+
+        return node;
+    }
+
+    void thread_impl::push_job(const char* job_name,
+                athd::pvt::job* job_ptr,
+                void* result,
+                c_twork work_fn,
+                c_tdone done_fn
+            )
+    {
+        push_node(new_node(job_name, job_ptr, result, work_fn, done_fn));
+    }
+
+    void thread_impl::push_node(node* node)
+    {
+        auto ok = false;
 
         mtx_.lock();
         ok = is_working_;
         if (ok)
         {
+            node->seq_ = push_seq_++;
+            if (node->deadline_)
+            {
+                deadline_count_++;
+            }
             if (job_head_)
             {
                 job_tail_->next_ = node;
@@ -225,8 +518,16 @@ namespace athd
         if (ok)
         {
             cv_.notify_one();
+            return;
         }
-        else
+
+        auto job_ptr = node->job_ptr_;
+        auto done_fn = node->done_fn_;
+        unref_token(node->token_);
+        node->token_ = nullptr;
+        node->job_name_ = "";
+        get_mdata()->nodes_.free(node);
+        if (done_fn)
         {
             done_fn(job_ptr);
         }
@@ -259,7 +560,8 @@ AA_API void  athd_pushpjob(void* pool,
                 std::uint64_t cid,
                 void* job_ptr,
                 c_twork work_fn,
-                c_tdone done_fn)
+                c_tdone done_fn,
+                const job_opt* opt)
 {
     auto p = static_cast<athd::pool_impl*>(pool);
     if (!p)
@@ -279,7 +581,132 @@ AA_API void  athd_pushpjob(void* pool,
     idx %= p->threads_.size();
     auto job = static_cast<athd::pvt::job*>(job_ptr);
     job->job_count_ = 1;
-    p->threads_[idx]->push_job(job_name, job, nullptr, work_fn, done_fn);
+    auto node = athd::new_node(job_name, job, nullptr, work_fn, done_fn, opt);
+    node->cid_ = cid;
+    p->threads_[idx]->push_node(node);
+}
+
+AA_API void  athd_cancelpjobs(void* pool, std::uint64_t cid)
+{
+    auto p = static_cast<athd::pool_impl*>(pool);
+    if (!p)
+    {
+        throw std::runtime_error("cancel_pjobs: 无效线程池指针");
+    }
+    if (!cid)
+    {
+        return;
+    }
+    p->threads_[cid % p->threads_.size()]->cancel_cid(cid);
+}
+
+AA_API void* athd_newtoken(void)
+{
+    return new athd::token_impl;
+}
+
+AA_API void  athd_reftoken(void* token)
+{
+    if (token)
+    {
+        static_cast<athd::token_impl*>(token)->ref_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+AA_API void  athd_unreftoken(void* token)
+{
+    athd::unref_token(static_cast<athd::token_impl*>(token));
+}
+
+AA_API void  athd_canceltoken(void* token)
+{
+    if (token)
+    {
+        static_cast<athd::token_impl*>(token)->epoch_.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+AA_API int   athd_getstatus(void)
+{
+    return athd::curr_job_status_;
+}
+
+AA_API void  athd_setedf(void* tp, bool v)
+{
+    if (!tp)
+    {
+        tp = athd::curr_thread_;
+    }
+    auto t = static_cast<athd::thread_impl*>(tp);
+    if (!t)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lk(t->mtx_);
+    t->is_edf_ = v;
+}
+
+AA_API void  athd_getstats(void* tp, thread_stats* out)
+{
+    if (!tp)
+    {
+        tp = athd::curr_thread_;
+    }
+    auto t = static_cast<athd::thread_impl*>(tp);
+    if (!t || !out)
+    {
+        return;
+    }
+    out->exec_count_ = t->exec_count_;
+    out->cancel_count_ = t->cancel_count_;
+    out->shed_count_ = t->shed_count_;
+    out->pending_count_ = t->job_count_;
+    out->tick_count_ = t->tick_count_;
+    out->overrun_count_ = t->overrun_count_;
+    out->skip_count_ = t->skip_count_;
+    out->max_frame_ns_ = t->max_frame_ns_;
+}
+
+AA_API std::uint64_t athd_getpending(void* tp)
+{
+    if (!tp)
+    {
+        tp = athd::curr_thread_;
+    }
+    auto t = static_cast<athd::thread_impl*>(tp);
+    if (!t)
+    {
+        return 0;
+    }
+    return (std::uint64_t)t->job_count_.load(std::memory_order_relaxed);
+}
+
+AA_API void  athd_settick(void* tp, std::uint64_t ms, int budget, c_twork fn, void* data, c_twork free_fn)
+{
+    if (!tp)
+    {
+        tp = athd::curr_thread_;
+    }
+    auto t = static_cast<athd::thread_impl*>(tp);
+    if (!t)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(t->mtx_);
+        t->tick_period_ns_ = ms * 1000000;
+        t->tick_budget_ = budget;
+        // 旧数据可能正被帧函数使用（或就是调用者自己），交给线程在帧外释放
+        if (t->tick_free_ && t->tick_data_)
+        {
+            t->tick_retired_.emplace_back(t->tick_free_, t->tick_data_);
+        }
+        t->tick_fn_ = fn;
+        t->tick_data_ = data;
+        t->tick_free_ = free_fn;
+        t->next_tick_ns_ = atime::nsec() + t->tick_period_ns_;
+    }
+    t->cv_.notify_one();
 }
 
 AA_API void* athd_getresult(void)
@@ -306,7 +733,8 @@ AA_API void  athd_pushtjob(void* t,
                 const char* job_name,
                 void* job_ptr,
                 c_twork work_fn,
-                c_tdone done_fn)
+                c_tdone done_fn,
+                const job_opt* opt)
 {
     if (t == (void*)1)
     {
@@ -317,7 +745,7 @@ AA_API void  athd_pushtjob(void* t,
         job->job_count_ = theads.size();
         for (auto& thread : theads)
         {
-            thread->push_job(job_name, job, nullptr, work_fn, done_fn);
+            thread->push_node(athd::new_node(job_name, job, nullptr, work_fn, done_fn, opt));
         }
         return;
     }
@@ -331,7 +759,7 @@ AA_API void  athd_pushtjob(void* t,
         }
         auto job = static_cast<athd::pvt::job*>(job_ptr);
         job->job_count_ = 1;
-        pt->push_job(job_name, job, nullptr, work_fn, done_fn);
+        pt->push_node(athd::new_node(job_name, job, nullptr, work_fn, done_fn, opt));
         return;
     }
     
@@ -343,7 +771,7 @@ AA_API void  athd_pushtjob(void* t,
     job->job_count_ = theads.size();
     for (auto& thread : theads)
     {
-        thread->push_job(job_name, job, nullptr, work_fn, done_fn);
+        thread->push_node(athd::new_node(job_name, job, nullptr, work_fn, done_fn, opt));
     }
 }
 
@@ -14,6 +14,13 @@ namespace athd
 {
     class thread_impl;
 
+    // 取消令牌：压入时记录epoch_，执行前不一致即已取消
+    struct token_impl
+    {
+        std::atomic_uint64_t epoch_{0};
+        std::atomic_int ref_count_{1};
+    };
+
     struct node
     {
         node* next_;
@@ -23,6 +30,28 @@ namespace athd
         void* result_;
         c_twork work_fn_;
         c_tdone done_fn_;
+        token_impl* token_;         // 取消令牌（可空），节点持有一个引用
+        std::uint64_t epoch_;       // 压入时的令牌纪元
+        std::uint64_t cid_;         // 线程池一致性ID，0：无
+        std::uint64_t seq_;         // 目标线程内的压入序号
+        std::uint64_t deadline_;    // 绝对截止时间（atime::nsec()），0：不限
+        int status_;                // 回执节点携带的作业状态
+    };
+
+    // ---------------------------- 消息缓冲池 --------------------------------
+    // 引用计数缓冲（athd::abuf）的分级池：64字节起按2的幂分级，超过max_size直接malloc；
+    //    任意线程分配/释放，先走线程本地缓存，缓存超限时一半归还全局链表
+    class mbuf_pool
+    {
+    public:
+        static constexpr int class_count = 11;                  // 64B ~ 64KB
+        static constexpr std::size_t min_size = 64;
+        static constexpr std::size_t max_size = 64 * 1024;
+        static constexpr std::size_t cache_bytes = 256 * 1024;  // 每线程每级缓存上限
+        static constexpr std::size_t global_bytes = 4 * 1024 * 1024; // 全局每级链表上限
+
+        static void* alloc(std::size_t size);
+        static void free(void* p);
     };
 
     class thread_impl
@@ -45,6 +74,11 @@ namespace athd
                 void* result,
                 c_twork work_fn,
                 c_tdone done_fn);
+        void push_node(node* n);
+        void cancel_cid(std::uint64_t cid);
+        int check_status(node* n);
+        void sort_by_deadline(node*& h, node*& t);
+        void do_tick();
         void stop()
         {
             push_job(nullptr, nullptr, nullptr, nullptr, nullptr);
@@ -63,6 +97,25 @@ namespace athd
         node*                     job_head_ = nullptr;
         node*                     job_tail_ = nullptr;
         std::uint64_t             job_timeout_limit_ = 50;
+        std::uint64_t             push_seq_ = 0;
+        std::atomic_int           cancel_cid_count_{0};
+        std::unordered_map<std::uint64_t, std::uint64_t> cancel_cids_;  // cid -> 序号上限（小于它的已取消）
+        bool                      is_edf_ = false;          // 每批作业按截止时间优先执行
+        int                       deadline_count_ = 0;      // 队列中带截止时间的作业数
+        std::atomic_uint64_t      exec_count_{0};
+        std::atomic_uint64_t      cancel_count_{0};
+        std::atomic_uint64_t      shed_count_{0};
+        std::uint64_t             tick_period_ns_ = 0;      // 定帧周期，0：事件驱动（非定帧）
+        std::uint64_t             next_tick_ns_ = 0;        // 下一帧的绝对时间（atime::nsec()）
+        int                       tick_budget_ = 0;         // 两次检查帧之间最多执行的作业数，0：不限
+        c_twork                   tick_fn_ = nullptr;
+        void*                     tick_data_ = nullptr;
+        c_twork                   tick_free_ = nullptr;     // 非空：tick_data_归本线程所有
+        std::vector<std::pair<c_twork, void*>> tick_retired_;  // 被替换的tick_data_，由本线程在帧外释放
+        std::atomic_uint64_t      tick_count_{0};
+        std::atomic_uint64_t      overrun_count_{0};
+        std::atomic_uint64_t      skip_count_{0};
+        std::atomic_uint64_t      max_frame_ns_{0};
         c_tfunc                   tfunc_;
         void*                     tdata_;
     };
@@ -165,6 +218,12 @@ namespace athd
     };
 
     thread_impl* do_new_thread(const char* name, c_tfunc tfunc = nullptr, void* tdata = nullptr, int ms = 0);
+    node* new_node(const char* job_name,
+                athd::pvt::job* job_ptr,
+                void* result,
+                c_twork work_fn,
+                c_tdone done_fn,
+                const job_opt* opt = nullptr);
 
     inline thread_impl* do_get_main()
     {
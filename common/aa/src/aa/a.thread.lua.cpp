@@ -2,6 +2,7 @@
 
 #include <lua.hpp>
 #include <cstring>
+#include <unordered_map>
 
 #include "alua.h"
 #include "athd.h"
@@ -66,6 +67,45 @@ namespace
         return ret;
     }
 
+    // 作业载荷：[名称长度][字节码长度][名称][字节码][参数]
+    struct job_view
+    {
+        std::string_view name_;
+        std::string_view func_;
+        std::string_view args_;
+    };
+
+    athd::abuf pack_job(std::string_view name, std::string_view func, std::string_view args)
+    {
+        std::uint32_t lens[2] = {(std::uint32_t)name.size(), (std::uint32_t)func.size()};
+        auto buf = athd::abuf::alloc(sizeof(lens) + name.size() + func.size() + args.size());
+        auto p = buf.wdata();
+        std::memcpy(p, lens, sizeof(lens));
+        p += sizeof(lens);
+        std::memcpy(p, name.data(), name.size());
+        p += name.size();
+        std::memcpy(p, func.data(), func.size());
+        p += func.size();
+        if (!args.empty())
+        {
+            std::memcpy(p, args.data(), args.size());
+        }
+        return buf;
+    }
+
+    job_view unpack_job(const athd::abuf& buf)
+    {
+        std::uint32_t lens[2];
+        std::memcpy(lens, buf.data(), sizeof(lens));
+        auto p = buf.data() + sizeof(lens);
+        job_view ret;
+        ret.name_ = std::string_view(p, lens[0]);
+        ret.func_ = std::string_view(p + lens[0], lens[1]);
+        auto used = sizeof(lens) + lens[0] + lens[1];
+        ret.args_ = std::string_view(p + lens[0] + lens[1], buf.size() - used);
+        return ret;
+    }
+
     static int lua_pushjob(int ispool, std::uint64_t cid, int sidx, lua_State* L)
     {
         auto p = lua_topointer(L, sidx++);
@@ -88,23 +128,27 @@ namespace
             alua::error("没有给定作业函数");
             return 0;
         }
-        std::string stfunc(tfunc, ln);
+        std::string_view vtfunc(tfunc, ln);
         
-        std::string sargs;
+        std::string_view vargs;
         auto args = lua_tolstring(L, sidx++, &ln);
         if(args)
         {
-            sargs.assign(args, ln);
+            vargs = std::string_view(args, ln);
         }
 
-        auto work_fn = [job_id, sargs, stfunc, sjob_name=std::string(job_name)]()
+        // 名称、字节码、参数打包进一个消息缓冲（athd_mbufalloc分级池），只复制一次；
+        //    abuf不是平凡可复制的，std::function仍会在堆上存放这个闭包，
+        //    不改捕获裸指针：作业被取消/超时丢弃时不执行，缓冲会泄漏
+        auto work_fn = [job_id, payload=pack_job(job_name, vtfunc, vargs)]()
             {
+                auto jv = unpack_job(payload);
                 if (!job_id)
                 {
-                    alua::call("athd", "onwork", sjob_name, stfunc, sargs);
+                    alua::call("athd", "onwork", jv.name_, jv.func_, jv.args_);
                     return;
                 }
-                auto ret = alua::call<std::string*>("athd", "onwork", sjob_name, stfunc, sargs);
+                auto ret = alua::call<std::string*>("athd", "onwork", jv.name_, jv.func_, jv.args_);
                 athd::setresult(ret);
             };
 
@@ -116,6 +160,12 @@ namespace
                     return;
                 }
                 auto sres = static_cast<std::string*>(athd::getresult());
+                if (!sres)
+                {
+                    // 作业已取消，没有返回值（athd.getstatus()可查询状态）
+                    alua::call("athd", "ondone", job_id);
+                    return;
+                }
                 alua::call("athd", "ondone", job_id, sres);
                 delete sres;
             };
@@ -155,6 +205,43 @@ namespace
         return 0;
     }
 
+    void cancel_pjobs(void* pool, std::uint64_t cid)
+    {
+        athd_cancelpjobs(pool, cid);
+    }
+
+    void set_edf(void* t, bool v)
+    {
+        athd_setedf(t, v);
+    }
+
+    std::unordered_map<std::string, std::uint64_t> get_stats(void* t)
+    {
+        thread_stats st;
+        athd_getstats(t, &st);
+        return {
+            {"exec", st.exec_count_},
+            {"cancel", st.cancel_count_},
+            {"shed", st.shed_count_},
+            {"pending", st.pending_count_},
+            {"tick", st.tick_count_},
+            {"overrun", st.overrun_count_},
+            {"skip", st.skip_count_},
+            {"maxframe", st.max_frame_ns_},
+        };
+    }
+
+    void on_lua_tick(void*)
+    {
+        alua::call("athd", "ontick");
+    }
+
+    // 当前线程进入定帧模式，每帧回调athd.ontick
+    void set_tick(std::uint64_t ms, int budget)
+    {
+        athd_settick(nullptr, ms, budget, ms ? on_lua_tick : nullptr, nullptr);
+    }
+
     static int lua_pushtjob(lua_State* L)
     {
         lua_pushjob(false, 0, 1, L);
@@ -188,6 +275,11 @@ namespace
                 {"pushtjob", lua_pushtjob},
                 {"pushpjob", lua_pushpjob},
                 {"pushpjobby", lua_pushpjobby},
+                {"cancelpjobs", alua::tocfunc<cancel_pjobs>()},
+                {"getstatus", alua::tocfunc<athd_getstatus>()},
+                {"setedf", alua::tocfunc<set_edf>()},
+                {"getstats", alua::tocfunc<get_stats>()},
+                {"settick", alua::tocfunc<set_tick>()},
                 {NULL, NULL}
             };
 
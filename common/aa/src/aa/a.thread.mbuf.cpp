@@ -0,0 +1,220 @@
+#include "ahcpp.h"
+
+#include <cstdlib>
+#include <mutex>
+
+#include "a.thread.h"
+
+namespace athd
+{
+    namespace
+    {
+        constexpr std::uint32_t heap_class = 0xff;
+
+        // 分配头：空闲时next_串成链表
+        struct alignas(16) mbuf_head
+        {
+            mbuf_head* next_;
+            std::uint32_t cls_;
+        };
+
+        inline std::size_t class_bytes(int cls)
+        {
+            return mbuf_pool::min_size << cls;
+        }
+
+        inline int size_class(std::size_t size)
+        {
+            int cls = 0;
+            while (class_bytes(cls) < size)
+            {
+                ++cls;
+            }
+            return cls;
+        }
+
+        inline int cache_limit(int cls)
+        {
+            auto n = (int)(mbuf_pool::cache_bytes / class_bytes(cls));
+            return n < 4 ? 4 : n;
+        }
+
+        struct global_list
+        {
+            std::mutex mtx_;
+            mbuf_head* head_ = nullptr;
+            int count_ = 0;
+        };
+
+        global_list* get_globals()
+        {
+            static global_list lists_[mbuf_pool::class_count];
+            return lists_;
+        }
+
+        // 归还全局链表，超出上限的直接释放
+        void give_back(int cls, mbuf_head* head)
+        {
+            auto& g = get_globals()[cls];
+            auto limit = (int)(mbuf_pool::global_bytes / class_bytes(cls));
+            {
+                std::lock_guard<std::mutex> lock(g.mtx_);
+                while (head && g.count_ < limit)
+                {
+                    auto next = head->next_;
+                    head->next_ = g.head_;
+                    g.head_ = head;
+                    g.count_++;
+                    head = next;
+                }
+            }
+            while (head)
+            {
+                auto next = head->next_;
+                std::free(head);
+                head = next;
+            }
+        }
+
+        // 线程缓存已析构：之后（其他thread_local析构中）的分配释放不再访问tls_cache_，直接走全局；
+        //    须是平凡析构的thread_local，析构后仍可读
+        thread_local bool tls_dead_ = false;
+
+        struct thread_cache
+        {
+            mbuf_head* heads_[mbuf_pool::class_count] = {};
+            int counts_[mbuf_pool::class_count] = {};
+
+            ~thread_cache()
+            {
+                for (int i = 0; i < mbuf_pool::class_count; ++i)
+                {
+                    give_back(i, heads_[i]);
+                    heads_[i] = nullptr;
+                    counts_[i] = 0;
+                }
+                tls_dead_ = true;
+            }
+
+            // 从全局链表取一批（缓存上限的一半）
+            void refill(int cls)
+            {
+                auto& g = get_globals()[cls];
+                auto want = cache_limit(cls) / 2;
+                std::lock_guard<std::mutex> lock(g.mtx_);
+                while (g.head_ && want--)
+                {
+                    auto h = g.head_;
+                    g.head_ = h->next_;
+                    g.count_--;
+                    h->next_ = heads_[cls];
+                    heads_[cls] = h;
+                    counts_[cls]++;
+                }
+            }
+
+            // 缓存超限：保留一半，其余归还
+            void spill(int cls)
+            {
+                auto keep = cache_limit(cls) / 2;
+                auto h = heads_[cls];
+                for (int i = 1; i < keep; ++i)
+                {
+                    h = h->next_;
+                }
+                auto rest = h->next_;
+                h->next_ = nullptr;
+                give_back(cls, rest);
+                counts_[cls] = keep;
+            }
+        };
+
+        thread_local thread_cache tls_cache_;
+    }
+
+    void* mbuf_pool::alloc(std::size_t size)
+    {
+        auto total = size + sizeof(mbuf_head);
+        if (total > max_size)
+        {
+            auto h = static_cast<mbuf_head*>(std::malloc(total));
+            if (!h)
+            {
+                return nullptr;
+            }
+            h->cls_ = heap_class;
+            return h + 1;
+        }
+
+        auto cls = size_class(total);
+        if (tls_dead_)
+        {
+            auto h = static_cast<mbuf_head*>(std::malloc(class_bytes(cls)));
+            if (!h)
+            {
+                return nullptr;
+            }
+            h->cls_ = (std::uint32_t)cls;
+            return h + 1;
+        }
+        auto& tc = tls_cache_;
+        if (!tc.heads_[cls])
+        {
+            tc.refill(cls);
+        }
+        auto h = tc.heads_[cls];
+        if (h)
+        {
+            tc.heads_[cls] = h->next_;
+            tc.counts_[cls]--;
+        }
+        else
+        {
+            h = static_cast<mbuf_head*>(std::malloc(class_bytes(cls)));
+            if (!h)
+            {
+                return nullptr;
+            }
+        }
+        h->cls_ = (std::uint32_t)cls;
+        return h + 1;
+    }
+
+    void mbuf_pool::free(void* p)
+    {
+        if (!p)
+        {
+            return;
+        }
+        auto h = static_cast<mbuf_head*>(p) - 1;
+        if (h->cls_ == heap_class)
+        {
+            std::free(h);
+            return;
+        }
+        auto cls = (int)h->cls_;
+        if (tls_dead_)
+        {
+            h->next_ = nullptr;
+            give_back(cls, h);
+            return;
+        }
+        auto& tc = tls_cache_;
+        h->next_ = tc.heads_[cls];
+        tc.heads_[cls] = h;
+        if (++tc.counts_[cls] > cache_limit(cls))
+        {
+            tc.spill(cls);
+        }
+    }
+}
+
+AA_API void* athd_mbufalloc(std::size_t size)
+{
+    return athd::mbuf_pool::alloc(size);
+}
+
+AA_API void  athd_mbuffree(void* p)
+{
+    athd::mbuf_pool::free(p);
+}
@@ -0,0 +1,197 @@
+// aahar-bench：ahar_send均衡方式压测，观察不均衡负载下各接收线程的排队深度
+//
+// 用法：aahar-bench [-t 接收线程数] [-k 慢线程倍数] [-c 单条耗时微秒] [-u 负载百分比] [-d 每轮毫秒]
+//    接收线程0处理每条消息的耗时是其它线程的k倍，发送线程按全部线程处理能力的u%匀速发送，
+//    依次用轮询、最少排队、按key粘滞（一半消息为同一个热点key）各跑一轮，每100毫秒打印一次各线程排队数
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ahar.h"
+#include "athd.h"
+
+namespace
+{
+    constexpr const char* msg_name = "bench.work";
+    constexpr int max_threads = 32;
+
+    struct options
+    {
+        int threads = 4;
+        int slow = 8;
+        int cost_us = 20;
+        int load = 70;
+        int duration_ms = 2000;
+    };
+
+    options opt;
+    thread_local int tls_idx_ = -1;
+    std::atomic_uint64_t handled_[max_threads];
+
+    using clock = std::chrono::steady_clock;
+
+    void spin_us(int us)
+    {
+        auto end = clock::now() + std::chrono::microseconds(us);
+        while (clock::now() < end)
+        {
+        }
+    }
+
+    void on_work(std::uint64_t, std::uint64_t, const atype::astr&, const atype::abuf&)
+    {
+        auto idx = tls_idx_;
+        spin_us(idx == 0 ? opt.cost_us * opt.slow : opt.cost_us);
+        handled_[idx].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool parse_args(int argc, char* argv[])
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string a = argv[i];
+            auto v = std::atoi(argv[i + 1]);
+            if (a == "-t")
+            {
+                opt.threads = v;
+            }
+            else if (a == "-k")
+            {
+                opt.slow = v;
+            }
+            else if (a == "-c")
+            {
+                opt.cost_us = v;
+            }
+            else if (a == "-u")
+            {
+                opt.load = v;
+            }
+            else if (a == "-d")
+            {
+                opt.duration_ms = v;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return (argc % 2) == 1 && opt.threads > 1 && opt.threads <= max_threads
+            && opt.slow > 0 && opt.cost_us > 0 && opt.load > 0 && opt.duration_ms > 0;
+    }
+
+    void run(const char* title, BalanceMode mode, const std::vector<athd::thread*>& workers, athd::thread* sender)
+    {
+        std::printf("== %s ==\n", title);
+        ahar::setbalance(msg_name, mode);
+        for (auto& h : handled_)
+        {
+            h.store(0);
+        }
+
+        // 全部线程每秒可处理的条数，按负载百分比折算发送间隔
+        auto capacity = (opt.threads - 1) * 1e6 / opt.cost_us + 1e6 / ((double)opt.cost_us * opt.slow);
+        auto rate = capacity * opt.load / 100;
+        auto mid = aid::crc32(msg_name);
+        std::atomic_bool is_done{false};
+        sender->pushjob("bench.send",
+            [&, mode, rate, mid]() -> void*
+            {
+                std::mt19937_64 rng(1);
+                auto start = clock::now();
+                auto end = start + std::chrono::milliseconds(opt.duration_ms);
+                std::uint64_t sent = 0;
+                for (auto now = start; now < end; now = clock::now())
+                {
+                    auto due = (std::uint64_t)(std::chrono::duration<double>(now - start).count() * rate);
+                    for (; sent < due; ++sent)
+                    {
+                        if (mode == BALANCE_STICKY)
+                        {
+                            auto key = (rng() & 1) ? 0 : rng() % 1000 + 1;
+                            ahar::sendby(key, mid, atype::abuf());
+                        }
+                        else
+                        {
+                            ahar::send(mid, atype::abuf());
+                        }
+                    }
+                }
+                is_done = true;
+                return nullptr;
+            });
+
+        std::vector<std::uint64_t> max_depth(workers.size());
+        std::printf("%8s", "ms");
+        for (std::size_t i = 0; i < workers.size(); ++i)
+        {
+            std::printf("%8s%zu", "q", i);
+        }
+        std::printf("\n");
+        auto start = clock::now();
+        for (bool is_draining = false; ; )
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            std::uint64_t total = 0;
+            std::printf("%8lld", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start).count());
+            for (std::size_t i = 0; i < workers.size(); ++i)
+            {
+                auto depth = athd::getpending(workers[i]);
+                max_depth[i] = std::max(max_depth[i], depth);
+                total += depth;
+                std::printf("%9llu", (unsigned long long)depth);
+            }
+            std::printf("\n");
+            if (is_draining && !total)
+            {
+                break;
+            }
+            is_draining = is_done.load();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start).count();
+        std::printf("%8s", "handled");
+        for (std::size_t i = 0; i < workers.size(); ++i)
+        {
+            std::printf("%9llu", (unsigned long long)handled_[i].load());
+        }
+        std::printf("\n%8s", "max");
+        for (auto d : max_depth)
+        {
+            std::printf("%9llu", (unsigned long long)d);
+        }
+        std::printf("\nelapsed(含排空): %lld ms\n\n", (long long)elapsed);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (!parse_args(argc, argv))
+    {
+        std::fprintf(stderr, "用法：aahar-bench [-t 接收线程数(2~%d)] [-k 慢线程倍数] [-c 单条耗时微秒] [-u 负载百分比] [-d 每轮毫秒]\n", max_threads);
+        return 1;
+    }
+    std::printf("接收线程%d个（线程0慢%d倍），单条%d微秒，负载%d%%，每轮%d毫秒\n\n",
+        opt.threads, opt.slow, opt.cost_us, opt.load, opt.duration_ms);
+
+    std::vector<athd::thread*> workers;
+    for (int i = 0; i < opt.threads; ++i)
+    {
+        auto t = athd::newthread(("bench" + std::to_string(i)).c_str(), nullptr, nullptr, 0);
+        t->pushjob("bench.init", [i]() -> void* { tls_idx_ = i; return nullptr; });
+        ahar::listen(msg_name, on_work, nullptr, t);
+        workers.push_back(t);
+    }
+    auto sender = athd::newthread("bench.sender", nullptr, nullptr, 0);
+
+    run("round-robin", BALANCE_ROUND_ROBIN, workers, sender);
+    run("least-pending", BALANCE_LEAST_PENDING, workers, sender);
+    run("sticky（一半为热点key）", BALANCE_STICKY, workers, sender);
+    std::fflush(stdout);
+    std::_Exit(0);
+}
@@ -0,0 +1,364 @@
+// aalog-tail：跟踪进程的共享内存实时日志环（见alogshm.h、alog_setlive），只读，不影响被跟踪进程
+//
+// 用法：aalog-tail [选项] <服务标志>
+//    服务标志与alog_setroot的process_flag相同（也可直接给共享内存名"/aalog.xxx"），不给时列出可跟踪的对象
+//    -l 等级     只看这些等级，逗号分隔：info,debug,warning,error（或i,d,w,e）
+//    -t tid      只看这个线程
+//    -g 日志文件 只看这个日志文件（如sys、lua，不区分大小写）
+//    -n 条数     开始时先输出最近的N条，默认20，-1输出环内全部
+//    -x          输出现有记录后退出，不跟踪
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alogshm.h"
+
+namespace
+{
+    const char* level_names[4] = {"INF", "DBG", "WAR", "ERR"};
+
+    struct options
+    {
+        std::string name;
+        unsigned levels = 0xf;
+        std::uint64_t tid = 0;
+        std::string logger;
+        long last = 20;
+        bool is_follow = true;
+    };
+
+    volatile sig_atomic_t g_stop = 0;
+
+    void usage()
+    {
+        std::fprintf(stderr,
+            "用法：aalog-tail [-l info,debug,warning,error] [-t tid] [-g 日志文件] [-n 条数] [-x] <服务标志>\n");
+    }
+
+    // 与alog_setroot生成文件名的替换规则一致
+    std::string shm_name(const std::string& flag)
+    {
+        if (!flag.empty() && flag[0] == '/')
+        {
+            return flag;
+        }
+        auto name = flag;
+        for (auto& c : name)
+        {
+            if (c == ':')
+            {
+                c = '.';
+            }
+            else if (c == '[' || c == ']' || c == '(' || c == ')' || c == '/')
+            {
+                c = '-';
+            }
+        }
+        return alog::shm::name_prefix + name;
+    }
+
+    void list_objects()
+    {
+        std::error_code ec;
+        std::string prefix = alog::shm::name_prefix + 1;
+        for (auto& e : std::filesystem::directory_iterator("/dev/shm", ec))
+        {
+            auto name = e.path().filename().string();
+            if (name.compare(0, prefix.size(), prefix) == 0)
+            {
+                std::printf("/%s\n", name.c_str());
+            }
+        }
+    }
+
+    bool parse_levels(const char* s, unsigned& out)
+    {
+        out = 0;
+        std::string v = s;
+        std::size_t from = 0;
+        while (from <= v.size())
+        {
+            auto to = v.find(',', from);
+            auto item = v.substr(from, to == std::string::npos ? std::string::npos : to - from);
+            if (item == "info" || item == "i")
+            {
+                out |= 1;
+            }
+            else if (item == "debug" || item == "d")
+            {
+                out |= 2;
+            }
+            else if (item == "warning" || item == "w")
+            {
+                out |= 4;
+            }
+            else if (item == "error" || item == "e")
+            {
+                out |= 8;
+            }
+            else
+            {
+                return false;
+            }
+            if (to == std::string::npos)
+            {
+                break;
+            }
+            from = to + 1;
+        }
+        return out != 0;
+    }
+
+    bool parse_args(int argc, char* argv[], options& opt)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string a = argv[i];
+            auto next = [&]() -> const char*
+            {
+                return i + 1 < argc ? argv[++i] : nullptr;
+            };
+            const char* v = nullptr;
+            if (a == "-l")
+            {
+                if (!(v = next()) || !parse_levels(v, opt.levels))
+                {
+                    return false;
+                }
+            }
+            else if (a == "-t")
+            {
+                if (!(v = next()))
+                {
+                    return false;
+                }
+                opt.tid = std::strtoull(v, nullptr, 10);
+            }
+            else if (a == "-g")
+            {
+                if (!(v = next()))
+                {
+                    return false;
+                }
+                opt.logger = v;
+                for (auto& c : opt.logger)
+                {
+                    c = (char)std::toupper((unsigned char)c);
+                }
+            }
+            else if (a == "-n")
+            {
+                if (!(v = next()))
+                {
+                    return false;
+                }
+                opt.last = std::strtol(v, nullptr, 10);
+            }
+            else if (a == "-x")
+            {
+                opt.is_follow = false;
+            }
+            else if (!a.empty() && a[0] == '-')
+            {
+                return false;
+            }
+            else
+            {
+                opt.name = shm_name(a);
+            }
+        }
+        return true;
+    }
+
+    bool match(const options& opt, const alog::shm::record* rec)
+    {
+        if (rec->level_ > 3 || !(opt.levels & (1u << rec->level_)))
+        {
+            return false;
+        }
+        if (opt.tid && rec->tid_ != opt.tid)
+        {
+            return false;
+        }
+        if (!opt.logger.empty() && std::strncmp(rec->logger_, opt.logger.c_str(), sizeof(rec->logger_)) != 0)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    std::string format(const alog::shm::record* rec)
+    {
+        time_t sec = (time_t)(rec->time_ / 1000);
+        struct tm tm_info;
+        localtime_r(&sec, &tm_info);
+        char head[128];
+        char logger[sizeof(rec->logger_) + 1] = {};
+        std::memcpy(logger, rec->logger_, sizeof(rec->logger_));
+        auto n = std::snprintf(head, sizeof(head), "[%04d-%02d-%02d %02d:%02d:%02d.%03d] [%s-%s] [%llu] >> ",
+            tm_info.tm_year + 1900, tm_info.tm_mon + 1, tm_info.tm_mday,
+            tm_info.tm_hour, tm_info.tm_min, tm_info.tm_sec, (int)(rec->time_ % 1000),
+            logger, level_names[rec->level_ & 3], (unsigned long long)rec->tid_);
+        std::string line(head, n);
+        std::size_t text_size = rec->text_size_;
+        while (text_size && (rec->text_[text_size - 1] == '\n' || rec->text_[text_size - 1] == '\r'))
+        {
+            --text_size;
+        }
+        line.append(rec->text_, text_size).append("\n");
+        return line;
+    }
+
+    // 按顺序锁拷贝[cursor, write_pos_)，返回新的cursor；lost累计被覆盖而错过的字节
+    std::uint64_t read_batch(const alog::shm::header* hdr, const char* data, std::uint64_t cursor,
+        std::vector<char>& out, std::uint64_t& lost)
+    {
+        auto cap = hdr->capacity_;
+        auto mask = cap - 1;
+        while (true)
+        {
+            auto s1 = hdr->seq_.load(std::memory_order_acquire);
+            if (s1 & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            auto end = hdr->write_pos_.load(std::memory_order_relaxed);
+            auto tail = hdr->tail_pos_.load(std::memory_order_relaxed);
+            if (cursor < tail)
+            {
+                lost += tail - cursor;
+                cursor = tail;
+            }
+            out.resize(end - cursor);
+            for (auto pos = cursor; pos < end;)
+            {
+                auto off = pos & mask;
+                auto n = std::min<std::uint64_t>(end - pos, cap - off);
+                std::memcpy(out.data() + (pos - cursor), data + off, n);
+                pos += n;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (hdr->seq_.load(std::memory_order_relaxed) == s1
+                || hdr->tail_pos_.load(std::memory_order_relaxed) <= cursor)
+            {
+                return cursor;
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    if (!parse_args(argc, argv, opt))
+    {
+        usage();
+        return 1;
+    }
+    if (opt.name.empty())
+    {
+        usage();
+        list_objects();
+        return 0;
+    }
+
+    int fd = shm_open(opt.name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "打开失败：%s（进程未开启实时日志环？）\n", opt.name.c_str());
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (std::size_t)st.st_size < sizeof(alog::shm::header))
+    {
+        std::fprintf(stderr, "对象大小不对：%s\n", opt.name.c_str());
+        return 1;
+    }
+    auto addr = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        std::fprintf(stderr, "映射失败：%s\n", opt.name.c_str());
+        return 1;
+    }
+    auto hdr = static_cast<const alog::shm::header*>(addr);
+    auto data = static_cast<const char*>(addr) + sizeof(alog::shm::header);
+    if (hdr->magic_ != alog::shm::magic || hdr->version_ != alog::shm::version
+        || sizeof(alog::shm::header) + hdr->capacity_ > (std::uint64_t)st.st_size)
+    {
+        std::fprintf(stderr, "不是实时日志环或版本不符：%s\n", opt.name.c_str());
+        return 1;
+    }
+    std::fprintf(stderr, ">> %s pid=%llu %s\n", opt.name.c_str(), (unsigned long long)hdr->pid_, hdr->process_flag_);
+
+    signal(SIGINT, [](int) { g_stop = 1; });
+    signal(SIGTERM, [](int) { g_stop = 1; });
+
+    std::vector<char> buf;
+    std::uint64_t lost = 0;
+    std::uint64_t cursor = 0;
+    bool is_first = true;
+    while (!g_stop)
+    {
+        cursor = read_batch(hdr, data, cursor, buf, lost);
+        std::deque<std::string> lines;
+        for (std::size_t off = 0; off + alog::shm::min_pad_size <= buf.size();)
+        {
+            auto rec = reinterpret_cast<const alog::shm::record*>(buf.data() + off);
+            auto min_size = rec->is_pad_ ? alog::shm::min_pad_size : sizeof(alog::shm::record);
+            if (rec->size_ < min_size || off + rec->size_ > buf.size())
+            {
+                break;
+            }
+            off += rec->size_;
+            if (rec->is_pad_ || !match(opt, rec))
+            {
+                continue;
+            }
+            lines.push_back(format(rec));
+            if (is_first && opt.last >= 0 && (long)lines.size() > opt.last)
+            {
+                lines.pop_front();
+            }
+        }
+        cursor += buf.size();
+        if (!is_first && lost)
+        {
+            std::fprintf(stdout, "<<< 跟不上写入速度，丢失约%llu字节 >>>\n", (unsigned long long)lost);
+        }
+        lost = 0;
+        for (auto& l : lines)
+        {
+            std::fwrite(l.data(), 1, l.size(), stdout);
+        }
+        std::fflush(stdout);
+        is_first = false;
+        if (!opt.is_follow)
+        {
+            break;
+        }
+        if (buf.empty())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+    munmap(addr, (std::size_t)st.st_size);
+    return 0;
+}